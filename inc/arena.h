@@ -0,0 +1,65 @@
+/*
+
+arena.h -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "art.h"
+#include "object.h"
+
+/*
+ * arena
+ */
+
+struct arena_chunk {
+    struct arena_chunk *    prev;       // previously filled chunk
+    size_t                  size;       // capacity (in bytes)
+    size_t                  used;       // bytes allocated
+};
+
+struct arena {
+    struct arena *          next;       // chain of all arenas
+    struct arena_chunk *    chunk;      // current chunk
+};
+
+struct arena_mark {
+    struct arena_chunk *    chunk;      // current chunk when marked
+    size_t                  used;       // bytes allocated in 'chunk' when marked
+};
+
+extern struct arena * arena_new();
+extern void * arena_alloc(struct arena * arena, size_t size);
+extern struct arena_mark arena_mark(struct arena * arena);
+extern void arena_rewind(struct arena * arena, struct arena_mark mark);
+extern void arena_reset(struct arena * arena);
+extern size_t arena_used(struct arena * arena);
+extern void arena_scan(void (*mark)(OOP));
+
+extern _Thread_local struct arena * arena_current;
+extern struct arena * arena_use(struct arena * arena);
+
+#endif /* _ARENA_H_ */
@@ -1,41 +1,60 @@
-/*
-
-art.h -- Actor Run-Time
-
-"MIT License"
-
-Copyright (c) 2013 Dale Schumacher, Tristan Slominski
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in
-all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-THE SOFTWARE.
-
-*/
-#ifndef _ART_H_
-#define _ART_H_
-
-#include <stddef.h>
-#include <stdlib.h>
-
-#define TRACE(x)    x   /* enable/disable trace statements */
-#define DEBUG(x)        /* enable/disable debug statements */
-
-#define ALLOC(S)    (calloc((S), 1))
-#define NEW(T)      ((T *)calloc(sizeof(T), 1))
-#define FREE(p)     ((p) = (free(p), NULL))
-
-#endif /* _ART_H_ */
+/*
+
+art.h -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#ifndef _ART_H_
+#define _ART_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#define TRACE(x)    x   /* enable/disable trace statements */
+#define DEBUG(x)        /* enable/disable debug statements */
+
+/*
+ * allocator
+ */
+
+struct allocator {
+    void *          (*alloc)(size_t size);  // allocate zero-filled memory
+    void            (*free)(void * p);      // release memory from 'alloc'
+};
+extern struct allocator system_allocator;
+extern struct allocator pool_allocator;
+extern struct allocator * art_allocator;   // select before allocating anything
+
+struct alloc_stats {
+    size_t          allocs;     // number of allocations
+    size_t          frees;      // number of releases
+    size_t          bytes;      // total bytes requested
+};
+extern void alloc_stats(struct alloc_stats * stats);
+
+#define ALLOC(S)    ((*art_allocator->alloc)(S))
+#define NEW(T)      ((T *)ALLOC(sizeof(T)))
+#define FREE(p)     ((p) = ((*art_allocator->free)(p), NULL))
+
+#endif /* _ART_H_ */
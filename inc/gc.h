@@ -0,0 +1,70 @@
+/*
+
+gc.h -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#ifndef _GC_H_
+#define _GC_H_
+
+#include "art.h"
+#include "object.h"
+
+/*
+ * garbage collection
+ */
+
+extern void * gc_alloc(size_t size);
+extern void gc_root(OOP * ref);
+extern void gc_unroot(OOP * ref);
+extern void gc_retain(OOP obj);
+extern void gc_release(OOP obj);
+extern size_t gc_collect();
+extern size_t gc_count();
+
+struct gc_header;
+
+struct gc_undo {
+    OOP *               field;      // word written in this transaction
+    OOP                 old;        // value before the write
+};
+
+struct gc_txn {
+    struct gc_txn *     prev;       // enclosing transaction (or NULL)
+    struct gc_header *  head;       // objects allocated in this transaction, newest first
+    struct gc_header *  tail;       // oldest object allocated in this transaction
+    size_t              count;      // number of objects allocated in this transaction
+    size_t              bytes;      // number of bytes allocated in this transaction
+    struct gc_undo *    undo;       // words to restore on abort, oldest first (or NULL)
+    size_t              undo_count;
+    size_t              undo_limit;
+};
+
+extern void gc_begin(struct gc_txn * txn);
+extern void gc_commit(struct gc_txn * txn);
+extern size_t gc_abort(struct gc_txn * txn);
+extern void gc_log(void * field);
+extern void gc_store(OOP * field, OOP value);
+
+#endif /* _GC_H_ */
@@ -1,79 +1,272 @@
-/*
-
-object.h -- Actor Run-Time
-
-"MIT License"
-
-Copyright (c) 2013 Dale Schumacher, Tristan Slominski
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in
-all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-THE SOFTWARE.
-
-*/
-#ifndef _OBJECT_H_
-#define _OBJECT_H_
-
-#include "art.h"
-#include <stdarg.h>
-
-typedef struct object * OOP;
-#define KIND(kind) OOP kind(OOP self, va_list args)
-typedef OOP (*DISP)(OOP self, va_list args);
-//#define DELEGATE(kind) (kind)(self, args) --- FIXME: ARGS CANNOT BE RE-TAKEN!
-
-/*
- * object
- */
-
-struct object {
-    DISP            kind;
-};
-
-#define take_arg() va_arg(args, OOP)
-
-extern OOP object_call(OOP obj, ...);
-extern OOP object_new(DISP kind, size_t size);
-#define object_alloc(structure, kind) ((structure *)object_new((kind), sizeof(structure)))
-
-//extern KIND(undef_kind);
-extern struct object undef_object;
-#define o_undef ((OOP)&undef_object)
-
-extern KIND(object_kind);
-
-/*
- * symbol
- */
-
-struct symbol {
-    struct object   o;
-    char *          s;
-};
-#define as_symbol(oop) ((struct symbol *)(oop))
-extern OOP symbol_new(char * name);
-extern KIND(symbol_kind);
-
-extern struct symbol _t_symbol;
-#define o_true ((OOP)&_t_symbol)
-extern struct symbol _f_symbol;
-#define o_false ((OOP)&_f_symbol)
-
-extern struct symbol eq_p_symbol;
-#define s_eq_p ((OOP)&eq_p_symbol)
-
-#endif /* _OBJECT_H_ */
+/*
+
+object.h -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#ifndef _OBJECT_H_
+#define _OBJECT_H_
+
+#include "art.h"
+#include <stdint.h>
+#include <stdatomic.h>
+
+typedef struct object * OOP;
+#define KIND(kind) OOP kind(OOP self, OOP * args)
+typedef OOP (*DISP)(OOP self, OOP * args);
+#define DELEGATE(kind) ((kind)(self, args))  // delegate the arguments not yet taken
+
+/*
+ * object
+ */
+
+struct object {
+    DISP            kind;
+};
+
+/*
+ * fixnum (immediate integer, tagged in the low bit of an OOP)
+ */
+
+#define FIXNUM_TAG          ((intptr_t)1)
+#define FIXNUM_MAX          (INTPTR_MAX >> 1)
+#define FIXNUM_MIN          (INTPTR_MIN >> 1)
+#define is_fixnum(oop)      (((intptr_t)(oop)) & FIXNUM_TAG)
+#define fixnum_new(n)       ((OOP)((((intptr_t)(n)) * 2) | FIXNUM_TAG))
+#define fixnum_value(oop)   ((int)(((intptr_t)(oop)) >> 1))
+extern KIND(integer_kind);
+
+#define kind_of(oop)        (is_fixnum(oop) ? integer_kind : (oop)->kind)
+
+/*
+ * message send
+ *
+ * The arguments of a message are passed to the kind as an array.
+ * 'take_arg' advances a local cursor, so the caller's arguments are never consumed,
+ * and a kind may DELEGATE its remaining arguments to another kind.
+ *
+ * 'object_callN' sends a selector 'cmd' with N fixed arguments.
+ * 'object_call' selects the fixed-arity entry-point from the number of arguments given.
+ */
+
+#define take_arg() (*args++)
+
+static inline OOP
+object_call0(OOP obj, OOP cmd)
+{
+    OOP argv[1];
+    argv[0] = cmd;
+    return (kind_of(obj))(obj, argv);
+}
+
+static inline OOP
+object_call1(OOP obj, OOP cmd, OOP a1)
+{
+    OOP argv[2];
+    argv[0] = cmd;
+    argv[1] = a1;
+    return (kind_of(obj))(obj, argv);
+}
+
+static inline OOP
+object_call2(OOP obj, OOP cmd, OOP a1, OOP a2)
+{
+    OOP argv[3];
+    argv[0] = cmd;
+    argv[1] = a1;
+    argv[2] = a2;
+    return (kind_of(obj))(obj, argv);
+}
+
+static inline OOP
+object_call3(OOP obj, OOP cmd, OOP a1, OOP a2, OOP a3)
+{
+    OOP argv[4];
+    argv[0] = cmd;
+    argv[1] = a1;
+    argv[2] = a2;
+    argv[3] = a3;
+    return (kind_of(obj))(obj, argv);
+}
+
+#define object_call(...) \
+    OBJECT_CALL_N(__VA_ARGS__, object_call3, object_call2, object_call1, object_call0, _)(__VA_ARGS__)
+#define OBJECT_CALL_N(obj, cmd, a1, a2, a3, call, ...) call
+
+extern OOP object_new(DISP kind, size_t size);
+#define object_alloc(structure, kind) ((structure *)object_new((kind), sizeof(structure)))
+
+//extern KIND(undef_kind);
+extern struct object undef_object;
+#define o_undef ((OOP)&undef_object)
+
+extern KIND(object_kind);
+extern KIND(object_eq_p);
+
+/*
+ * symbol
+ */
+
+enum selector {  // selector ids of the built-in message symbols
+    SEL_NONE = 0,               // not a selector
+    SEL_EQ_P,
+    SEL_EMPTY_P,
+    SEL_PUSH,
+    SEL_POP,
+    SEL_PUT,
+    SEL_PULL,
+    SEL_GIVE_X,
+    SEL_TAKE_X,
+    SEL_BIND,
+    SEL_LOOKUP,
+    SEL_ADD,
+    SEL_MATCH,
+    SEL_EVAL,
+    SEL_COMBINE,
+    SEL_CREATE_X,
+    SEL_SEND_X,
+    SEL_BECOME_X,
+    SEL_DISPATCH_X,
+    SEL_GIVE_ALL_X,
+    SEL_MATCH_X,
+    SEL_SPAN,
+    SEL_MAX
+};
+
+struct symbol {
+    struct object   o;
+    char *          s;
+    int             sel;        // selector id (or SEL_NONE)
+    size_t          hash;       // hash of 's' (interned symbols only)
+};
+#define as_symbol(oop) ((struct symbol *)(oop))
+extern OOP symbol_new(char * name);
+extern OOP symbol_new_n(char * name, size_t n);
+extern KIND(symbol_kind);
+
+#define selector_of(oop) ((symbol_kind == kind_of(oop)) ? as_symbol(oop)->sel : SEL_NONE)
+
+/*
+ * methods
+ */
+
+struct methods {
+    DISP            kind;               // kind implemented by this table
+    DISP            other;              // fallback for other selectors (or NULL)
+    DISP            method[SEL_MAX];    // method for each selector (or NULL)
+    struct methods * next;              // chain of tables seen by methods_dispatch
+    atomic_int      linked;             // non-zero once on the chain
+};
+extern void methods_link(struct methods * mt);
+extern struct methods * methods_lookup(DISP kind);
+
+static inline OOP
+methods_dispatch(struct methods * mt, OOP self, OOP * args)
+{
+    if (!mt->linked) {
+        methods_link(mt);  // make this table visible to inline caches
+    }
+    DISP method = mt->method[selector_of(args[0])];
+    if (method != NULL) {
+        return (*method)(self, args + 1);
+    }
+    if (mt->other != NULL) {
+        return (*mt->other)(self, args);
+    }
+    return o_undef;
+}
+
+/*
+ * inline cache
+ *
+ * A call site that repeatedly sends the same selector keeps the method tables
+ * of the receiver kinds it has seen.  A hit jumps straight to the handler.
+ * A miss resolves the kind through methods_lookup() and makes a plain call.
+ * Caches are shared between threads, so entries and counters are relaxed atomics.
+ */
+
+#define ICACHE_WAYS (4)             // receiver kinds remembered per call site
+
+struct icache {
+    char *          site;               // call-site description (for reports)
+    struct icache * next;               // chain of caches that have been used
+    _Atomic(struct methods *) entry[ICACHE_WAYS]; // method tables of receivers seen
+    atomic_uint     victim;             // next entry to replace when full
+    atomic_int      linked;             // non-zero once on the chain
+    atomic_size_t   hits;               // (counts racing on other threads may be lost)
+    atomic_size_t   misses;
+};
+#define ICACHE_INIT(site) { (site) }
+extern _Atomic(struct icache *) icache_list;
+extern OOP icache_miss(struct icache * ic, OOP obj, OOP * argv);
+extern void icache_reset();
+
+static inline void
+icache_count(atomic_size_t * counter)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+static inline OOP
+icache_send(struct icache * ic, OOP obj, OOP * argv)
+{
+    DISP kind = kind_of(obj);
+    int i;
+    for (i = 0; i < ICACHE_WAYS; ++i) {
+        struct methods * mt = atomic_load_explicit(&ic->entry[i], memory_order_relaxed);
+        if (mt == NULL) {
+            break;
+        }
+        if (mt->kind == kind) {
+            icache_count(&ic->hits);
+            int sel = selector_of(argv[0]);
+            if (sel != SEL_NONE) {
+                DISP method = mt->method[sel];
+                if (method != NULL) {
+                    return (*method)(obj, argv + 1);
+                }
+            }
+            return (*kind)(obj, argv);  // as object_call would
+        }
+    }
+    return icache_miss(ic, obj, argv);
+}
+static inline OOP
+icache_call1(struct icache * ic, OOP obj, OOP cmd, OOP a1)
+{
+    OOP argv[2];
+    argv[0] = cmd;
+    argv[1] = a1;
+    return icache_send(ic, obj, argv);
+}
+
+extern struct symbol _t_symbol;
+#define o_true ((OOP)&_t_symbol)
+extern struct symbol _f_symbol;
+#define o_false ((OOP)&_f_symbol)
+
+extern struct symbol eq_p_symbol;
+#define s_eq_p ((OOP)&eq_p_symbol)
+
+#endif /* _OBJECT_H_ */
@@ -0,0 +1,81 @@
+/*
+
+pconfig.h -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#ifndef _PCONFIG_H_
+#define _PCONFIG_H_
+
+#include "art.h"
+#include "object.h"
+#include "actor.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * work-stealing deque
+ */
+
+struct deque {
+    atomic_long     top;        // next index to steal from
+    atomic_long     bottom;     // next index to push at (owner only)
+    _Atomic(OOP)    ring;       // circular buffer of actors (a retained heap object)
+};
+
+/*
+ * parallel configuration
+ */
+
+struct worker {
+    struct pconfig *    config;     // configuration served by this worker
+    pthread_t           thread;
+    struct deque        deque;      // ready actors, mostly made ready by this worker
+    unsigned int        seed;       // for choosing steal victims
+};
+
+struct pconfig {
+    struct object       o;
+    OOP                 actors;     // queue of actors made ready from outside (guarded by 'lock')
+    atomic_long         ready;      // number of actors in 'actors'
+    atomic_long         remain;     // number of undispatched events
+    atomic_long         budget;     // number of events this 'dispatch!' may still deliver
+    atomic_int          running;    // non-zero while workers should look for events
+    int                 n_workers;
+    struct worker *     workers;
+    pthread_mutex_t     lock;
+    pthread_cond_t      start;      // signalled to begin a 'dispatch!'
+    pthread_cond_t      done;       // signalled when progress may let 'dispatch!' return
+    long                generation; // number of 'dispatch!' calls started
+    int                 parked;     // number of workers waiting for 'start'
+    int                 shutdown;   // non-zero when workers should exit
+    int                 deterministic;  // non-zero to deliver on one worker, in a reproducible order
+    int                 quota;      // events per actor turn, served round-robin (0 for unfair batches)
+};
+#define as_pconfig(oop) ((struct pconfig *)(oop))
+extern OOP pconfig_new(int n_workers);
+extern void pconfig_stop(OOP config);
+extern KIND(pconfig_kind);
+
+#endif /* _PCONFIG_H_ */
@@ -0,0 +1,80 @@
+/*
+
+pvm.h -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#ifndef _PVM_H_
+#define _PVM_H_
+
+#include "art.h"
+#include "object.h"
+#include "pattern.h"
+
+/*
+ * pattern virtual machine
+ */
+
+enum pvm_op {
+    PVM_FAIL,               // fail
+    PVM_EMPTY,              // out := ()
+    PVM_ALL,                // out := in
+    PVM_END,                // fail unless 'in' is empty, out := ()
+    PVM_ANY,                // (out, in) := pop(in)
+    PVM_EQ,                 // (out, in) := pop(in), fail unless 'value' = out
+    PVM_IF,                 // (out, in) := pop(in), fail unless 'value'(out) is true
+    PVM_SET,                // (out, in) := pop(in), fail unless out is in charset 'value' (or not, if 'arg')
+    PVM_SPAN,               // repeat SET while it succeeds (never fails)
+    PVM_BIND,               // env := env.bind('value', out)
+    PVM_PUSH,               // push 'out' on the value stack
+    PVM_PAIR,               // out := (pop(), out)
+    PVM_CHOICE,             // push a backtrack entry, resuming at 'arg' on failure
+    PVM_COMMIT,             // drop the backtrack entry, and jump to 'arg'
+    PVM_PARTIAL_COMMIT,     // update the backtrack entry to the current state, and jump to 'arg'
+    PVM_CALL,               // push a return entry, and jump to 'arg'
+    PVM_RETURN,             // pop a return entry, and jump back
+    PVM_MEMO,               // on a remembered result of memo 'value', take it and jump to 'arg' + 1 (or fail),
+                            //   otherwise push a backtrack entry, resuming at 'arg' on failure
+    PVM_MEMO_COMMIT,        // pop the MEMO backtrack entry, remember success, and jump to 'arg'
+    PVM_MEMO_FAIL,          // remember failure, and fail
+    PVM_MATCH,              // match with pattern 'value' (not compiled)
+    PVM_HALT                // succeed
+};
+
+struct pvm_instr {
+    int             op;         // operation (enum pvm_op)
+    int             arg;        // jump target
+    OOP             value;      // operand
+};
+
+struct pvm_pattern {
+    struct object   o;
+    int             count;      // number of instructions
+    struct pvm_instr code[];
+};
+#define as_pvm_pattern(oop) ((struct pvm_pattern *)(oop))
+extern OOP pattern_compile(OOP ptrn);
+extern KIND(pvm_pattern_kind);
+
+#endif /* _PVM_H_ */
@@ -0,0 +1,85 @@
+/*
+
+remote.h -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#ifndef _REMOTE_H_
+#define _REMOTE_H_
+
+#include "art.h"
+#include "object.h"
+#include "actor.h"
+#include <pthread.h>
+
+/*
+ * link (sending end of a connection)
+ */
+
+struct link {
+    struct object       o;
+    int                 fd;         // connected stream socket (Unix domain)
+    char *              buf;        // batch of frames not yet written
+    size_t              size;       // capacity of 'buf'
+    size_t              used;       // bytes in 'buf' (including the batch header)
+    pthread_mutex_t     lock;       // guards 'buf' (proxies may run on several workers)
+    atomic_int          error;      // errno of the first failed write (or 0)
+};
+#define as_link(oop) ((struct link *)(oop))
+extern OOP link_new(int fd);
+extern int link_flush(OOP link);
+extern int link_close(OOP link);
+extern KIND(link_kind);
+
+struct proxy_beh {
+    struct object       o;
+    OOP                 link;       // connection to the remote process
+    int                 id;         // remote actor, as exported by the receiver
+};
+#define as_proxy_beh(oop) ((struct proxy_beh *)(oop))
+extern OOP proxy_beh_new(OOP link, int id);
+extern KIND(proxy_beh_kind);
+
+/*
+ * receiver (receiving end of a connection)
+ */
+
+struct receiver {
+    struct object       o;
+    int                 fd;         // connected stream socket (Unix domain)
+    OOP                 config;     // configuration given the events received
+    OOP                 exports;    // actors that may be sent messages, indexed by id (a heap object)
+    int                 n_exports;
+    int                 limit;      // capacity of 'exports'
+    char *              buf;        // batch being decoded
+    size_t              size;       // capacity of 'buf'
+};
+#define as_receiver(oop) ((struct receiver *)(oop))
+extern OOP receiver_new(int fd, OOP config);
+extern int receiver_export(OOP receiver, OOP actor);
+extern int receiver_poll(OOP receiver);
+extern void receiver_close(OOP receiver);
+extern KIND(receiver_kind);
+
+#endif /* _REMOTE_H_ */
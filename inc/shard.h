@@ -0,0 +1,82 @@
+/*
+
+shard.h -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#ifndef _SHARD_H_
+#define _SHARD_H_
+
+#include "art.h"
+#include "object.h"
+#include "actor.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * single-producer single-consumer queue
+ */
+
+struct spsc {
+    atomic_long     head;       // next index to take from (consumer only)
+    atomic_long     tail;       // next index to put at (producer only)
+    OOP             ring;       // circular buffer of events (a retained heap object)
+    long            size;       // capacity of 'ring' (a power of 2)
+    OOP             overflow;   // queue of events that did not fit in 'ring' (producer only)
+};
+
+/*
+ * sharded configuration
+ */
+
+struct shard {
+    struct shards *     group;      // sharded configuration this shard belongs to
+    int                 index;
+    OOP                 config;     // configuration owning the actors of this shard
+    pthread_t           thread;     // dispatching thread, pinned to one core (where supported)
+};
+
+struct shards {
+    struct object       o;
+    int                 n_shards;
+    struct shard *      shard;
+    struct spsc *       queue;      // n_shards x n_shards queues, indexed [from * n_shards + to]
+    atomic_long         remain;     // number of undispatched events, in all shards
+    atomic_long         budget;     // number of events this 'dispatch!' may still deliver
+    atomic_long         claimed;    // budget claimed by shards, but not yet given back
+    atomic_int          running;    // non-zero while shards should dispatch
+    pthread_mutex_t     lock;
+    pthread_cond_t      start;      // signalled to begin a 'dispatch!'
+    pthread_cond_t      done;       // signalled when progress may let 'dispatch!' return
+    long                generation; // number of 'dispatch!' calls started
+    int                 parked;     // number of shards waiting for 'start'
+    int                 shutdown;   // non-zero when shards should exit
+};
+#define as_shards(oop) ((struct shards *)(oop))
+extern OOP shards_new(int n_shards);
+extern OOP shards_config(OOP shards, int index);
+extern void shards_stop(OOP shards);
+extern KIND(shards_kind);
+
+#endif /* _SHARD_H_ */
@@ -1,266 +1,755 @@
-/*
-
-actor.c -- Actor Run-Time
-
-"MIT License"
-
-Copyright (c) 2013 Dale Schumacher, Tristan Slominski
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in
-all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-THE SOFTWARE.
-
-*/
-
-#include <stdio.h>  /* for TRACE */
-#include "actor.h"
-#include "pair.h"
-
-/*
-actor:
-    Actors encapsulate state/behavior reacting to asynchronous events (messages).
-    
-    NOTE: Actor objects are not intended to be called directly, but if they are
-          they simply delegate to their behavior 'beh'
-*/
-
-OOP
-actor_new(OOP beh)
-{
-    struct actor * this = object_alloc(struct actor, actor_kind);
-    this->beh = beh;
-    return (OOP)this;
-}
-
-KIND(actor_kind)
-{
-    struct actor * this = as_actor(self);
-    TRACE(fprintf(stderr, "%p(actor_kind, %p)\n", this, this->beh));
-    OOP event = take_arg();
-    TRACE(fprintf(stderr, "  %p: event=%p\n", this, event));
-    if (event == s_eq_p) {  // support default object protocol
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    }
-    return object_call(this->beh, event);
-}
-
-/*
-event:
-    Events are unique occurances of a particular 'msg' for a specific 'actor'.
-    When the message is delivered to the actor, the effects are held in the event.
-    The event acts as the "sponsor" for the computation, providing resources to the actor.
-    
-    actor := o.create!(beh)     -- return a new actor with initial behavior 'beh'
-    o.send!(actor, message)     -- send 'message' to 'actor' asynchronously
-    o.become!(beh)              -- use behavior 'beh' to process subsequent messages
-    o.dispatch!()               -- deliver 'msg' to 'actor'
-*/
-
-struct symbol create_x_symbol = { { symbol_kind }, "create!" };
-struct symbol send_x_symbol = { { symbol_kind }, "send!" };
-struct symbol become_x_symbol = { { symbol_kind }, "become!" };
-struct symbol dispatch_x_symbol = { { symbol_kind }, "dispatch!" };
-
-OOP
-event_new(OOP actor, OOP msg)
-{
-    struct event * this = object_alloc(struct event, event_kind);
-    this->actor = actor;
-    this->msg = msg;
-    return (OOP)this;
-}
-
-KIND(event_kind)
-{
-    struct event * this = as_event(self);
-    TRACE(fprintf(stderr, "%p event_kind {actor:%p, msg:%p}\n", this, this->actor, this->msg));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", this, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_dispatch_x) {
-        OOP beh = as_actor(this->actor)->beh;
-        TRACE(fprintf(stderr, "  %p: dispatch {beh:%p}\n", this, beh));
-        this->actors = o_nil;  // empty actor stack
-        this->events = o_nil;  // empty event stack
-        this->beh = beh;
-        return object_call(beh, this);  // invoke actor behavior
-    } else if (cmd == s_create_x) {
-        OOP beh = take_arg();
-        TRACE(fprintf(stderr, "  %p: create {beh:%p}\n", this, beh));
-        OOP actor = actor_new(beh);
-        this->actors = object_call(this->actors, s_push, actor);  // add actor to stack
-        return actor;
-    } else if (cmd == s_send_x) {
-        OOP actor = take_arg();
-        OOP msg = take_arg();
-        TRACE(fprintf(stderr, "  %p: send {actor:%p, msg:%p}\n", this, actor, msg));
-        OOP event = event_new(actor, msg);
-        this->events = object_call(this->events, s_push, event);  // add event to stack
-        return event;
-    } else if (cmd == s_become_x) {
-        OOP beh = take_arg();
-        TRACE(fprintf(stderr, "  %p: become {beh:%p}\n", this, beh));
-        this->beh = beh;
-        return beh;
-    }
-    return o_undef;
-}
-
-/*
-behavior:
-    Behaviors cause "effects" for an actor, using a sponsor
-
-    o.(event)    -- cause effects triggered by 'event'
-*/
-
-static KIND(empty_beh_kind)
-{
-    TRACE(fprintf(stderr, "%p(empty_beh_kind)\n", self));
-    OOP evt = take_arg();
-    OOP act = as_event(evt)->actor;
-    OOP msg = as_event(evt)->msg;
-    TRACE(fprintf(stderr, "  %p: event=%p {actor:%p, msg:%p}\n", self, evt, act, msg));
-    return o_true;  // commit
-}
-
-struct object empty_beh = { empty_beh_kind };
-struct actor sink_actor = { { actor_kind }, beh_empty };
-
-OOP
-forward_beh_new(OOP target)
-{
-    struct forward_beh * this = object_alloc(struct forward_beh, forward_beh_kind);
-    this->target = target;
-    return (OOP)this;
-}
-
-KIND(forward_beh_kind)
-{
-    struct forward_beh * this = as_forward_beh(self);
-    TRACE(fprintf(stderr, "%p forward_beh_kind {target:%p}\n", this, this->target));
-    OOP evt = take_arg();
-    OOP act = as_event(evt)->actor;
-    OOP msg = as_event(evt)->msg;
-    TRACE(fprintf(stderr, "  %p: event=%p {actor:%p, msg:%p}\n", self, evt, act, msg));
-    object_call(evt, s_send_x, this->target, msg);
-    return o_true;  // commit
-}
-
-OOP
-one_shot_beh_new(OOP target)
-{
-    struct forward_beh * this = object_alloc(struct forward_beh, one_shot_beh_kind);
-    this->target = target;
-    return (OOP)this;
-}
-
-KIND(one_shot_beh_kind)
-{
-    struct forward_beh * this = as_forward_beh(self);
-    TRACE(fprintf(stderr, "%p one_shot_beh_kind {target:%p}\n", this, this->target));
-    OOP evt = take_arg();
-    OOP act = as_event(evt)->actor;
-    OOP msg = as_event(evt)->msg;
-    TRACE(fprintf(stderr, "  %p: event=%p {actor:%p, msg:%p}\n", self, evt, act, msg));
-    object_call(evt, s_send_x, this->target, msg);
-    object_call(evt, s_become_x, beh_empty);  // BECOME sink_beh
-    return o_true;  // commit
-}
-
-/*
-config:
-    Configurations are collections of actors and in-flight message-events.
-    
-    remain := o.dispatch!(count)-- dispatch up to 'count' events, return how many 'remain'
-    remain := o.give!(event)    -- add 'event' to the queue of in-flight events
-*/
-
-OOP
-config_new()
-{
-    struct config * this = object_alloc(struct config, config_kind);
-    this->events = queue_new();
-    this->remain = n_0;
-    return (OOP)this;
-}
-
-KIND(config_kind)
-{
-    struct config * this = as_config(self);
-    TRACE(fprintf(stderr, "%p config_kind {remain:%d}\n", this, as_integer(this->remain)->n));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", this, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_give_x) {
-        // enqueue an event
-        OOP evt = take_arg();
-        TRACE(fprintf(stderr, "  %p: give! {event:%p}\n", this, evt));
-        object_call(this->events, s_give_x, evt);
-        this->remain = object_call(this->remain, s_add, n_1);
-        TRACE(fprintf(stderr, "  %p: remain=%d\n", this, as_integer(this->remain)->n));
-        return this->remain;
-    } else if (cmd == s_dispatch_x) {
-        // dispatch up to 'count' events
-        OOP count = take_arg();
-        TRACE(fprintf(stderr, "  %p: dispatch {count:%d}\n", this, as_integer(count)->n));
-        while ((object_call(count, s_eq_p, n_0) != o_true)
-        &&     (object_call(this->events, s_empty_p) == o_false)) {
-            // dequeue next event
-            OOP evt = object_call(this->events, s_take_x);
-            TRACE(fprintf(stderr, "  %p: event=%p\n", this, evt));
-            this->remain = object_call(this->remain, s_add, n_minus_1);
-            TRACE(fprintf(stderr, "  %p: remain=%d\n", this, as_integer(this->remain)->n));
-            // dispatch event
-            OOP result = object_call(evt, s_dispatch_x);
-            TRACE(fprintf(stderr, "  %p: result=%p\n", this, result));
-            // apply result
-            if (o_true == result) {
-                struct event * ep = as_event(evt);
-                OOP events = ep->events;
-                while (o_nil != events) {  // enqueue events
-                    struct pair * pp = as_pair(object_call(events, s_pop));
-                    TRACE(fprintf(stderr, "  %p: events=[%p]^%p\n", this, pp->h, pp->t));
-                    object_call(self, s_give_x, pp->h);
-                    events = pp->t;
-                }
-                as_actor(ep->actor)->beh = ep->beh;  // replace behavior
-                TRACE(fprintf(stderr, "  %p: beh=%p\n", this, ep->beh));
-            } else {
-                TRACE(fprintf(stderr, "  %p: event=%p ---ABORTED---", this, evt));
-            }
-            // decrement count
-            count = object_call(count, s_add, n_minus_1);
-            TRACE(fprintf(stderr, "  %p: count=%d\n", this, as_integer(count)->n));
-        }
-        return this->remain;
-    }
-    return o_undef;
-}
+/*
+
+actor.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stdio.h>  /* for TRACE */
+#include <string.h>
+#include "actor.h"
+#include "pair.h"
+#include "gc.h"
+
+/*
+actor:
+    Actors encapsulate state/behavior reacting to asynchronous events (messages).
+    
+    NOTE: Actor objects are not intended to be called directly, but if they are
+          they simply delegate to their behavior 'beh'
+*/
+
+OOP
+actor_new(OOP beh)
+{
+    struct actor * this = object_alloc(struct actor, actor_kind);
+    this->beh = beh;
+    return (OOP)this;
+}
+
+KIND(actor_kind)
+{
+    struct actor * this = as_actor(self);
+    TRACE(fprintf(stderr, "%p(actor_kind, %p)\n", this, this->beh));
+    OOP event = take_arg();
+    TRACE(fprintf(stderr, "  %p: event=%p\n", this, event));
+    if (event == s_eq_p) {  // support default object protocol
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    }
+    return object_call(this->beh, event);
+}
+
+/*
+event:
+    Events are unique occurances of a particular 'msg' for a specific 'actor'.
+    When the message is delivered to the actor, the effects are held in the event.
+    The event acts as the "sponsor" for the computation, providing resources to the actor.
+
+    The first message sent is held in place ('send_to' and 'send_msg'), without an event of its own.
+    A configuration may deliver it directly, without an effect buffer (see "config"),
+    or 'event_flush' adds it to 'events', before any other message is sent.
+
+    Output that leaves the configuration (such as a frame for a remote link) is added to 'output',
+    and 'event_perform' sends each item 'dispatch!' once the event has committed,
+    so an aborted event never writes anything.
+    
+    actor := o.create!(beh)     -- return a new actor with initial behavior 'beh'
+    o.send!(actor, message)     -- send 'message' to 'actor' asynchronously
+    o.become!(beh)              -- use behavior 'beh' to process subsequent messages
+    o.dispatch!()               -- deliver 'msg' to 'actor'
+*/
+
+struct symbol create_x_symbol = { { symbol_kind }, "create!", SEL_CREATE_X };
+struct symbol send_x_symbol = { { symbol_kind }, "send!", SEL_SEND_X };
+struct symbol become_x_symbol = { { symbol_kind }, "become!", SEL_BECOME_X };
+struct symbol dispatch_x_symbol = { { symbol_kind }, "dispatch!", SEL_DISPATCH_X };
+struct symbol give_all_x_symbol = { { symbol_kind }, "give_all!", SEL_GIVE_ALL_X };
+
+OOP
+event_new(OOP actor, OOP msg)
+{
+    struct event * this = object_alloc(struct event, event_kind);
+    this->actor = actor;
+    this->msg = msg;
+    this->sponsor = o_nil;
+    this->send_to = NULL;
+    this->output = o_nil;
+    return (OOP)this;
+}
+
+/*
+    Give the first message sent by 'evt', if it is still held in place, an event of its own in 'events'.
+*/
+void
+event_flush(OOP evt)
+{
+    struct event * this = as_event(evt);
+    if (this->send_to != NULL) {
+        OOP event = event_new(this->send_to, this->send_msg);
+        as_event(event)->sponsor = this->sponsor;  // effects share the sponsor of their cause
+        this->send_to = NULL;
+        this->events = effects_add(this->events, event);
+    }
+}
+
+/*
+    Perform the output of a committed event, in the order it was added.
+*/
+void
+event_perform(OOP evt)
+{
+    struct event * this = as_event(evt);
+    if (o_nil != this->output) {
+        struct effects * fp = as_effects(this->output);
+        long i;
+        for (i = 0; i < fp->count; ++i) {
+            object_call(fp->event[i], s_dispatch_x);
+        }
+        this->output = o_nil;
+    }
+}
+
+static KIND(event_dispatch_x)
+{
+    struct event * this = as_event(self);
+    TRACE(fprintf(stderr, "%p event_kind {actor:%p, msg:%p}\n", this, this->actor, this->msg));
+    OOP beh = as_actor(this->actor)->beh;
+    TRACE(fprintf(stderr, "  %p: dispatch {beh:%p}\n", this, beh));
+    this->actors = o_nil;  // empty actor stack
+    this->events = o_nil;  // no events sent
+    this->send_to = NULL;
+    this->output = o_nil;  // no output
+    this->beh = beh;
+    return object_call(beh, self);  // invoke actor behavior
+}
+
+static KIND(event_create_x)
+{
+    struct event * this = as_event(self);
+    TRACE(fprintf(stderr, "%p event_kind {actor:%p, msg:%p}\n", this, this->actor, this->msg));
+    OOP beh = take_arg();
+    TRACE(fprintf(stderr, "  %p: create {beh:%p}\n", this, beh));
+    OOP actor = actor_new(beh);
+    as_actor(actor)->config = as_actor(this->actor)->config;  // owned with its creator
+    this->actors = object_call(this->actors, s_push, actor);  // add actor to stack
+    return actor;
+}
+
+static KIND(event_send_x)
+{
+    struct event * this = as_event(self);
+    TRACE(fprintf(stderr, "%p event_kind {actor:%p, msg:%p}\n", this, this->actor, this->msg));
+    OOP actor = take_arg();
+    OOP msg = take_arg();
+    TRACE(fprintf(stderr, "  %p: send {actor:%p, msg:%p}\n", this, actor, msg));
+    if (o_nil != this->sponsor) {
+        struct sponsor * sp = as_sponsor(this->sponsor);
+        if (atomic_fetch_sub(&sp->messages, 1) <= 0) {
+            atomic_store(&sp->suspended, 1);  // message budget exhausted
+        }
+    }
+    if ((this->send_to == NULL) && (o_nil == this->events)) {  // first message, held in place
+        this->send_to = actor;
+        this->send_msg = msg;
+        return actor;
+    }
+    event_flush(self);
+    OOP event = event_new(actor, msg);
+    as_event(event)->sponsor = this->sponsor;  // effects share the sponsor of their cause
+    this->events = effects_add(this->events, event);  // append event to effects
+    return actor;
+}
+
+static KIND(event_become_x)
+{
+    struct event * this = as_event(self);
+    TRACE(fprintf(stderr, "%p event_kind {actor:%p, msg:%p}\n", this, this->actor, this->msg));
+    OOP beh = take_arg();
+    TRACE(fprintf(stderr, "  %p: become {beh:%p}\n", this, beh));
+    this->beh = beh;
+    return beh;
+}
+
+static struct methods event_methods = {
+    event_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_DISPATCH_X] = event_dispatch_x,
+        [SEL_CREATE_X] = event_create_x,
+        [SEL_SEND_X] = event_send_x,
+        [SEL_BECOME_X] = event_become_x,
+    }
+};
+
+KIND(event_kind)
+{
+    return methods_dispatch(&event_methods, self, args);
+}
+
+/*
+effects:
+    An effect buffer is an append-only vector of the events sent during one dispatch, in the order sent.
+    It is allocated on the first send, with room for a few events, and doubles as needed.
+    Committed effects are queued in send order, with a single 'give_all!'.
+*/
+
+#define EFFECTS_INIT_SIZE   (4)
+
+static OOP
+effects_new(long size)
+{
+    struct effects * this = (struct effects *)object_new(effects_kind, sizeof(struct effects) + size * sizeof(OOP));
+    this->size = size;
+    return (OOP)this;
+}
+
+/*
+    Append 'event' to 'effects' (or o_nil), returning the (possibly new) effect buffer.
+*/
+OOP
+effects_add(OOP effects, OOP event)
+{
+    struct effects * this = (o_nil == effects)
+        ? as_effects(effects_new(EFFECTS_INIT_SIZE))
+        : as_effects(effects);
+    if (this->count >= this->size) {
+        struct effects * bigger = as_effects(effects_new(this->size << 1));
+        memcpy(bigger->event, this->event, this->count * sizeof(OOP));
+        bigger->count = this->count;
+        this = bigger;
+    }
+    this->event[this->count++] = event;
+    return (OOP)this;
+}
+
+static struct methods effects_methods = {
+    effects_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+    }
+};
+
+KIND(effects_kind)
+{
+    return methods_dispatch(&effects_methods, self, args);
+}
+
+/*
+sponsor:
+    Sponsors meter the resources used by a graph of events.
+    Events given to a configuration may name a sponsor, and the events they send share it.
+
+    Each 'send!' charges one message.  The objects and bytes allocated while dispatching an event
+    (including the actors it creates) are charged when the event commits.
+    The charges of an aborted event are refunded.
+
+    An event that exhausts a budget is aborted, its sponsor is suspended, and the event is held.
+    Every configuration (sequential, parallel, or sharded) holds the events of a suspended sponsor,
+    instead of dispatching them, until 'sponsor_refill' adds to its budgets and gives the held events back.
+    The budgets may be shared by events dispatched on several threads at once.
+
+    NOTE: Allocations are metered by heap transactions, so not for a 'config' with an arena.
+          A sponsor holding events must be kept reachable (e.g.: with 'gc_root').
+          Refill a sponsor only while its configuration is stopped (between calls to 'dispatch!').
+*/
+
+OOP
+sponsor_new(long messages, long allocs, long bytes)
+{
+    struct sponsor * this = object_alloc(struct sponsor, sponsor_kind);
+    atomic_init(&this->messages, messages);
+    atomic_init(&this->allocs, allocs);
+    atomic_init(&this->bytes, bytes);
+    atomic_init(&this->suspended, 0);
+    atomic_init(&this->held, NULL);
+    return (OOP)this;
+}
+
+/*
+    Add to the budgets of 'sponsor', resuming it, and give its held events to 'config'.
+*/
+OOP
+sponsor_refill(OOP sponsor, OOP config, long messages, long allocs, long bytes)
+{
+    struct sponsor * this = as_sponsor(sponsor);
+    atomic_fetch_add(&this->messages, messages);
+    atomic_fetch_add(&this->allocs, allocs);
+    atomic_fetch_add(&this->bytes, bytes);
+    atomic_store(&this->suspended, 0);
+    OOP events = o_nil;
+    OOP evt = atomic_exchange(&this->held, NULL);
+    while (evt != NULL) {  // restore original order
+        OOP next = as_event(evt)->next;
+        as_event(evt)->next = NULL;
+        events = pair_new(evt, events);
+        evt = next;
+    }
+    return object_call(config, s_give_all_x, events);
+}
+
+/*
+    Hold 'evt' until its (suspended) sponsor is refilled.
+*/
+void
+sponsor_hold(struct sponsor * sp, OOP evt)
+{
+    struct event * ep = as_event(evt);
+    OOP head = atomic_load(&sp->held);
+    do {
+        ep->next = head;
+    } while (!atomic_compare_exchange_weak(&sp->held, &head, evt));
+}
+
+/*
+    Charge a dispatched event for the objects and bytes it allocated,
+    returning zero (and refunding the charge) if it may not commit, because the sponsor is suspended.
+*/
+int
+sponsor_charge(struct sponsor * sp, long allocs, long bytes)
+{
+    long a = atomic_fetch_sub(&sp->allocs, allocs) - allocs;
+    long b = atomic_fetch_sub(&sp->bytes, bytes) - bytes;
+    if ((a < 0) || (b < 0)) {
+        atomic_store(&sp->suspended, 1);  // allocation budget exhausted
+    }
+    if (atomic_load(&sp->suspended)) {
+        atomic_fetch_add(&sp->allocs, allocs);
+        atomic_fetch_add(&sp->bytes, bytes);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+    Refund the messages sent by an event that did not commit.
+*/
+void
+sponsor_refund(struct sponsor * sp, OOP evt)
+{
+    struct event * ep = as_event(evt);
+    if (o_nil != ep->events) {
+        atomic_fetch_add(&sp->messages, as_effects(ep->events)->count);
+    }
+    if (ep->send_to != NULL) {
+        atomic_fetch_add(&sp->messages, 1);
+    }
+}
+
+static struct methods sponsor_methods = {
+    sponsor_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+    }
+};
+
+KIND(sponsor_kind)
+{
+    return methods_dispatch(&sponsor_methods, self, args);
+}
+
+/*
+behavior:
+    Behaviors cause "effects" for an actor, using a sponsor
+
+    o.(event)    -- cause effects triggered by 'event'
+*/
+
+static KIND(empty_beh_kind)
+{
+    TRACE(fprintf(stderr, "%p(empty_beh_kind)\n", self));
+    OOP evt = take_arg();
+    OOP act = as_event(evt)->actor;
+    OOP msg = as_event(evt)->msg;
+    TRACE(fprintf(stderr, "  %p: event=%p {actor:%p, msg:%p}\n", self, evt, act, msg));
+    return o_true;  // commit
+}
+
+struct object empty_beh = { empty_beh_kind };
+struct actor sink_actor = { { actor_kind }, beh_empty };
+
+OOP
+forward_beh_new(OOP target)
+{
+    struct forward_beh * this = object_alloc(struct forward_beh, forward_beh_kind);
+    this->target = target;
+    return (OOP)this;
+}
+
+KIND(forward_beh_kind)
+{
+    struct forward_beh * this = as_forward_beh(self);
+    TRACE(fprintf(stderr, "%p forward_beh_kind {target:%p}\n", this, this->target));
+    OOP evt = take_arg();
+    OOP act = as_event(evt)->actor;
+    OOP msg = as_event(evt)->msg;
+    TRACE(fprintf(stderr, "  %p: event=%p {actor:%p, msg:%p}\n", self, evt, act, msg));
+    object_call(evt, s_send_x, this->target, msg);
+    return o_true;  // commit
+}
+
+OOP
+one_shot_beh_new(OOP target)
+{
+    struct forward_beh * this = object_alloc(struct forward_beh, one_shot_beh_kind);
+    this->target = target;
+    return (OOP)this;
+}
+
+KIND(one_shot_beh_kind)
+{
+    struct forward_beh * this = as_forward_beh(self);
+    TRACE(fprintf(stderr, "%p one_shot_beh_kind {target:%p}\n", this, this->target));
+    OOP evt = take_arg();
+    OOP act = as_event(evt)->actor;
+    OOP msg = as_event(evt)->msg;
+    TRACE(fprintf(stderr, "  %p: event=%p {actor:%p, msg:%p}\n", self, evt, act, msg));
+    object_call(evt, s_send_x, this->target, msg);
+    object_call(evt, s_become_x, beh_empty);  // BECOME sink_beh
+    return o_true;  // commit
+}
+
+/*
+config:
+    Configurations are collections of actors and in-flight message-events.
+    
+    remain := o.dispatch!(count)-- dispatch up to 'count' events, return how many 'remain'
+    remain := o.give!(event)    -- add 'event' to the queue of in-flight events
+    remain := o.give_all!(list) -- add each event in 'list' (or an effect buffer) to the queue of in-flight events
+
+    In-flight events are held in a circular buffer, which doubles when full.
+    The effects of a committed event are copied into the buffer with a single 'give_all!'.
+    Events are delivered in the order they were given, and the effects of each event in the order sent,
+    so dispatching the same events always produces the same schedule.
+
+    If 'router' is set, committed events for actors owned by another configuration
+    are given to the 'router' instead (see "shard.c"). Actors created by an event
+    are owned by the configuration that owns the creating actor.
+
+    When a committed event sends exactly one message, and no other events are waiting,
+    that message is delivered directly, for up to CONFIG_HANDOFF hops in a row.
+    The message gets a fresh event, made while the sender is dispatched (so it is metered, and released
+    if the sender aborts), but no effect buffer, and it skips the buffer. The committed event is left
+    as it was dispatched, for any behavior or effect that kept it. Each hop still counts as one dispatch,
+    so the schedule is unchanged.
+
+    NOTE: Configurations are retained as garbage-collection roots,
+          so their queued events (and everything reachable from them) stay alive.
+
+    The objects allocated while an event is dispatched (actors created, events sent, new behaviors,
+    and any other state) are held in a garbage-collection transaction (see "gc.c").
+    They join the heap when the event commits, and are freed as soon as it aborts.
+    Existing objects that may refer to new ones must be updated with 'gc_store',
+    which is rolled back when the event aborts.
+
+    If 'arena' is set, the effects of each event are allocated from that arena instead.
+    The effects of an aborted event are released immediately by rewinding the arena.
+    Each event still runs in a heap transaction, so words stored into older objects (with 'gc_store')
+    are restored before the arena is rewound, and nothing is left pointing into released memory.
+    When a batch of events has been dispatched, and nothing refers to the objects it created,
+    the owner of the configuration may release them all at once with 'arena_reset'.
+*/
+
+#define CONFIG_INIT_SIZE    (64)
+#define CONFIG_HANDOFF      (16)    // consecutive direct deliveries, before using the buffer
+#define config_slot(ring)   ((OOP *)((struct object *)(ring) + 1))  // events follow the header
+
+static OOP
+config_ring_new(long size)
+{
+    struct object * ring = (struct object *)gc_alloc(sizeof(struct object) + size * sizeof(OOP));
+    ring->kind = object_kind;
+    return (OOP)ring;
+}
+
+/*
+    Make room for 'n' more events, preserving the order of the queued events.
+*/
+static OOP *
+config_reserve(struct config * this, long n)
+{
+    OOP * slot = config_slot(this->ring);
+    if ((this->remain + n) > this->size) {
+        long size = this->size;
+        while ((this->remain + n) > size) {
+            size <<= 1;
+        }
+        OOP ring = config_ring_new(size);
+        OOP * bigger = config_slot(ring);
+        long first = this->size - this->head;  // events up to the end of 'slot'
+        if (first > this->remain) {
+            first = this->remain;
+        }
+        memcpy(bigger, slot + this->head, first * sizeof(OOP));
+        memcpy(bigger + first, slot, (this->remain - first) * sizeof(OOP));
+        this->ring = ring;
+        this->size = size;
+        this->head = 0;
+        slot = bigger;
+    }
+    return slot;
+}
+
+OOP
+config_new()
+{
+    struct config * this = object_alloc(struct config, config_kind);
+    this->ring = config_ring_new(CONFIG_INIT_SIZE);
+    this->size = CONFIG_INIT_SIZE;
+    this->head = 0;
+    this->remain = 0;
+    this->arena = NULL;
+    this->router = o_nil;
+    this->dispatched = 0;
+    gc_retain((OOP)this);
+    return (OOP)this;
+}
+
+/*
+    Add 'evt' to the end of the queue.
+*/
+static void
+config_enqueue(struct config * this, OOP evt)
+{
+    OOP * slot = config_reserve(this, 1);
+    slot[(this->head + this->remain) & (this->size - 1)] = evt;
+    ++this->remain;
+    TRACE(fprintf(stderr, "  %p: remain=%ld\n", this, this->remain));
+}
+
+/*
+    Add each event in 'list' (or an effect buffer) to the end of the queue, in order.
+*/
+static void
+config_enqueue_all(struct config * this, OOP list)
+{
+    if (effects_kind == kind_of(list)) {
+        struct effects * ep = as_effects(list);
+        OOP * slot = config_reserve(this, ep->count);
+        long tail = (this->head + this->remain) & (this->size - 1);
+        long first = this->size - tail;  // slots up to the end of 'slot'
+        if (first > ep->count) {
+            first = ep->count;
+        }
+        memcpy(slot + tail, ep->event, first * sizeof(OOP));
+        memcpy(slot, ep->event + first, (ep->count - first) * sizeof(OOP));
+        this->remain += ep->count;
+        TRACE(fprintf(stderr, "  %p: remain=%ld\n", this, this->remain));
+        return;
+    }
+    long n = 0;
+    OOP events;
+    for (events = list; o_nil != events; events = as_pair(events)->t) {
+        ++n;
+    }
+    OOP * slot = config_reserve(this, n);
+    long mask = this->size - 1;
+    long i = this->head + this->remain;
+    for (events = list; o_nil != events; events = as_pair(events)->t) {
+        slot[i++ & mask] = as_pair(events)->h;
+    }
+    this->remain += n;
+    TRACE(fprintf(stderr, "  %p: remain=%ld\n", this, this->remain));
+}
+
+static KIND(config_give_x)
+{
+    struct config * this = as_config(self);
+    TRACE(fprintf(stderr, "%p config_kind {remain:%ld}\n", this, this->remain));
+    // enqueue an event
+    OOP evt = take_arg();
+    TRACE(fprintf(stderr, "  %p: give! {event:%p}\n", this, evt));
+    config_enqueue(this, evt);
+    return integer_new(this->remain);
+}
+
+static KIND(config_give_all_x)
+{
+    struct config * this = as_config(self);
+    TRACE(fprintf(stderr, "%p config_kind {remain:%ld}\n", this, this->remain));
+    // enqueue a list of events
+    OOP list = take_arg();
+    TRACE(fprintf(stderr, "  %p: give_all! {events:%p}\n", this, list));
+    config_enqueue_all(this, list);
+    return integer_new(this->remain);
+}
+
+/*
+    Queue the events in an effect buffer, giving those for actors owned elsewhere to the 'router'.
+*/
+static void
+config_route(struct config * this, OOP events)
+{
+    struct effects * ep = as_effects(events);
+    long i;
+    for (i = 0; i < ep->count; ++i) {
+        OOP evt = ep->event[i];
+        OOP owner = as_actor(as_event(evt)->actor)->config;
+        if (owner == (OOP)this) {
+            config_enqueue(this, evt);
+        } else {
+            object_call(this->router, s_give_x, evt);
+        }
+    }
+}
+
+/*
+    Return non-zero if a message for 'actor' may be handed off directly (see above).
+    Actors with no owner are only local without a 'router', which decides where they run.
+*/
+static int
+config_local(struct config * this, OOP actor)
+{
+    OOP owner = as_actor(actor)->config;
+    return (o_nil == this->router) || (owner == (OOP)this);
+}
+
+static KIND(config_dispatch_x)
+{
+    struct config * this = as_config(self);
+    TRACE(fprintf(stderr, "%p config_kind {remain:%ld}\n", this, this->remain));
+    // dispatch up to 'count' events
+    OOP count = take_arg();
+    TRACE(fprintf(stderr, "  %p: dispatch {count:%d}\n", this, integer_value(count)));
+    OOP next = NULL;  // event handed off by the previous dispatch
+    int hops = 0;
+    while ((object_call(count, s_eq_p, n_0) != o_true)
+    &&     ((next != NULL) || (this->remain > 0))) {
+        OOP evt;
+        if (next != NULL) {
+            evt = next;
+            next = NULL;
+            ++hops;
+            TRACE(fprintf(stderr, "  %p: event=%p ---HANDOFF---\n", this, evt));
+        } else {
+            // dequeue next event
+            OOP * slot = config_slot(this->ring);
+            evt = slot[this->head];
+            slot[this->head] = NULL;  // don't retain delivered events
+            this->head = (this->head + 1) & (this->size - 1);
+            --this->remain;
+            hops = 0;
+            TRACE(fprintf(stderr, "  %p: event=%p\n", this, evt));
+            TRACE(fprintf(stderr, "  %p: remain=%ld\n", this, this->remain));
+        }
+        ++this->dispatched;
+        struct event * ep = as_event(evt);
+        struct sponsor * sp = (o_nil != ep->sponsor) ? as_sponsor(ep->sponsor) : NULL;
+        if ((sp != NULL) && atomic_load(&sp->suspended)) {
+            TRACE(fprintf(stderr, "  %p: event=%p ---HELD---\n", this, evt));
+            sponsor_hold(sp, evt);  // hold until refilled
+            count = object_call(count, s_add, n_minus_1);
+            continue;
+        }
+        // dispatch event
+        struct arena_mark mark;
+        struct arena * prev = NULL;
+        struct gc_txn txn;
+        gc_begin(&txn);  // undo log for stores into older objects (even with an arena)
+        if (this->arena != NULL) {
+            mark = arena_mark(this->arena);
+            prev = arena_use(this->arena);
+        }
+        OOP result = object_call(evt, s_dispatch_x);
+        TRACE(fprintf(stderr, "  %p: result=%p\n", this, result));
+        int handoff = (o_true == result) && (this->remain == 0) && (hops < CONFIG_HANDOFF)
+                   && (ep->send_to != NULL) && (o_nil == ep->events) && config_local(this, ep->send_to);
+        OOP hand = NULL;  // event for a direct delivery
+        if (handoff) {
+            hand = event_new(ep->send_to, ep->send_msg);
+            as_event(hand)->sponsor = ep->sponsor;  // effects share the sponsor of their cause
+        } else {
+            event_flush(evt);  // the first message needs an event of its own
+        }
+        int exhausted = 0;
+        if (sp != NULL) {  // check budgets
+            if ((o_true == result)
+            &&  !sponsor_charge(sp, (this->arena == NULL) ? (long)txn.count : 0,
+                                    (this->arena == NULL) ? (long)txn.bytes : 0)) {
+                TRACE(fprintf(stderr, "  %p: sponsor=%p ---EXHAUSTED---\n", this, sp));
+                result = o_false;
+                exhausted = 1;
+            }
+            if (o_true != result) {
+                sponsor_refund(sp, evt);
+            }
+        }
+        if (this->arena != NULL) {
+            arena_use(prev);
+        }
+        if (o_true == result) {
+            gc_commit(&txn);
+        } else {
+            gc_abort(&txn);  // release aborted effects, and restore stored words
+            if (this->arena != NULL) {
+                arena_rewind(this->arena, mark);  // only once nothing older points into it
+            }
+        }
+        // apply result
+        if (o_true == result) {
+            as_actor(ep->actor)->beh = ep->beh;  // replace behavior
+            TRACE(fprintf(stderr, "  %p: beh=%p\n", this, ep->beh));
+            event_perform(evt);
+            if (handoff) {  // deliver directly
+                ep->send_to = NULL;  // sent, by 'hand'
+                next = hand;
+            } else if ((o_nil != this->router) && (o_nil != ep->events)) {
+                config_route(this, ep->events);
+            } else if (o_nil != ep->events) {
+                config_enqueue_all(this, ep->events);  // enqueue events
+            }
+        } else {
+            TRACE(fprintf(stderr, "  %p: event=%p ---ABORTED---", this, evt));
+            ep->actors = o_nil;  // forget released effects
+            ep->events = o_nil;
+            ep->send_to = NULL;
+            ep->output = o_nil;
+            ep->beh = as_actor(ep->actor)->beh;
+            if (exhausted) {
+                sponsor_hold(sp, evt);  // retry when refilled
+            }
+        }
+        // decrement count
+        count = object_call(count, s_add, n_minus_1);
+        TRACE(fprintf(stderr, "  %p: count=%d\n", this, integer_value(count)));
+    }
+    if (next != NULL) {  // count exhausted, queue the handoff
+        config_enqueue(this, next);
+    }
+    return integer_new(this->remain);
+}
+
+static struct methods config_methods = {
+    config_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_GIVE_X] = config_give_x,
+        [SEL_GIVE_ALL_X] = config_give_all_x,
+        [SEL_DISPATCH_X] = config_dispatch_x,
+    }
+};
+
+KIND(config_kind)
+{
+    return methods_dispatch(&config_methods, self, args);
+}
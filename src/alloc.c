@@ -0,0 +1,206 @@
+/*
+
+alloc.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "art.h"
+
+/*
+allocator:
+    All memory used by the run-time is obtained through 'ALLOC'/'NEW' and released by 'FREE'.
+    These dispatch through 'art_allocator', which may be changed at run-time (before allocating),
+    or chosen at build-time by defining ART_ALLOCATOR (e.g.: -DART_ALLOCATOR=system_allocator).
+
+    The "system" allocator uses calloc/free.
+
+    The "pool" allocator serves small requests from size-class free-lists carved out of slabs.
+    Each slab is aligned on its own size, so the size class of a block is found from its address.
+    Each thread has a private cache of free-lists, so allocation needs no locks.
+    Blocks released by another thread join the free-lists of the releasing thread.
+    Large requests get a dedicated (aligned) block of their own.
+*/
+
+#ifndef ART_ALLOCATOR
+#define ART_ALLOCATOR       pool_allocator
+#endif
+
+#define POOL_SLAB_SIZE      (64 * 1024)
+#define POOL_HEADER_SIZE    (16)
+#define POOL_CLASSES        (22)
+#define POOL_LARGE          (POOL_CLASSES)
+
+static const size_t pool_class_size[POOL_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256,
+    320, 384, 512, 768, 1024, 2048
+};
+
+struct pool_slab {
+    size_t                  class;      // size class of blocks (or POOL_LARGE)
+    size_t                  size;       // size of a POOL_LARGE block
+};
+#define pool_slab_of(p) ((struct pool_slab *)((uintptr_t)(p) & ~(uintptr_t)(POOL_SLAB_SIZE - 1)))
+
+struct pool_cache {
+    struct pool_cache *     next;       // chain of all caches
+    void *                  free[POOL_CLASSES];  // free-lists by size class
+    struct alloc_stats      stats;      // allocation counters for this thread
+};
+
+static _Atomic(struct pool_cache *) pool_caches = NULL;  // chain of all caches
+static _Thread_local struct pool_cache * pool_local = NULL;  // cache for this thread
+
+static struct pool_cache *
+pool_cache()
+{
+    struct pool_cache * cache = pool_local;
+    if (cache == NULL) {
+        cache = (struct pool_cache *)calloc(sizeof(struct pool_cache), 1);
+        cache->next = atomic_load(&pool_caches);
+        while (!atomic_compare_exchange_weak(&pool_caches, &cache->next, cache))
+            ;
+        pool_local = cache;
+    }
+    return cache;
+}
+
+static size_t
+pool_class_of(size_t size)
+{
+    size_t class = (size <= 256) ? ((size + 15) >> 4) : 16;
+    if (class > 0) {
+        --class;
+    }
+    while ((class < POOL_CLASSES) && (pool_class_size[class] < size)) {
+        ++class;
+    }
+    return class;
+}
+
+static void *
+pool_slab_new(size_t class, size_t size)
+{
+    void * p = NULL;
+    if (posix_memalign(&p, POOL_SLAB_SIZE, size) != 0) {
+        return NULL;
+    }
+    struct pool_slab * slab = (struct pool_slab *)p;
+    slab->class = class;
+    slab->size = size;
+    return slab;
+}
+
+static void *
+pool_alloc(size_t size)
+{
+    struct pool_cache * cache = pool_cache();
+    ++cache->stats.allocs;
+    cache->stats.bytes += size;
+    size_t class = pool_class_of(size);
+    if (class == POOL_LARGE) {
+        char * p = pool_slab_new(POOL_LARGE, POOL_HEADER_SIZE + size);
+        if (p == NULL) {
+            return NULL;
+        }
+        memset(p + POOL_HEADER_SIZE, 0, size);
+        return p + POOL_HEADER_SIZE;
+    }
+    void ** block = cache->free[class];
+    if (block == NULL) {  // carve a new slab into blocks
+        size_t n = pool_class_size[class];
+        char * p = pool_slab_new(class, POOL_SLAB_SIZE);
+        if (p == NULL) {
+            return NULL;
+        }
+        size_t i = (POOL_SLAB_SIZE - POOL_HEADER_SIZE) / n;
+        while (i-- > 0) {
+            void ** q = (void **)(p + POOL_HEADER_SIZE + (i * n));
+            *q = block;
+            block = q;
+        }
+    }
+    cache->free[class] = *block;
+    memset(block, 0, size);
+    return block;
+}
+
+static void
+pool_free(void * p)
+{
+    if (p == NULL) {
+        return;
+    }
+    struct pool_cache * cache = pool_cache();
+    ++cache->stats.frees;
+    struct pool_slab * slab = pool_slab_of((char *)p - POOL_HEADER_SIZE);
+    if (slab->class == POOL_LARGE) {
+        free(slab);
+        return;
+    }
+    *(void **)p = cache->free[slab->class];
+    cache->free[slab->class] = p;
+}
+
+struct allocator pool_allocator = { pool_alloc, pool_free };
+
+static void *
+system_alloc(size_t size)
+{
+    struct pool_cache * cache = pool_cache();
+    ++cache->stats.allocs;
+    cache->stats.bytes += size;
+    return calloc(size, 1);
+}
+
+static void
+system_free(void * p)
+{
+    if (p != NULL) {
+        ++pool_cache()->stats.frees;
+    }
+    free(p);
+}
+
+struct allocator system_allocator = { system_alloc, system_free };
+
+struct allocator * art_allocator = &ART_ALLOCATOR;
+
+/*
+    Sum the allocation counters of all threads into 'stats'.
+*/
+void
+alloc_stats(struct alloc_stats * stats)
+{
+    struct pool_cache * cache;
+    memset(stats, 0, sizeof(struct alloc_stats));
+    for (cache = atomic_load(&pool_caches); cache != NULL; cache = cache->next) {
+        stats->allocs += cache->stats.allocs;
+        stats->frees += cache->stats.frees;
+        stats->bytes += cache->stats.bytes;
+    }
+}
@@ -0,0 +1,159 @@
+/*
+
+arena.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <string.h>
+#include <stdatomic.h>
+#include "arena.h"
+
+/*
+arena:
+    Arenas are regions of memory allocated by bumping a pointer.
+    Objects in an arena are never freed individually.
+    Instead, the arena is rewound to a previous mark, or reset, releasing everything allocated since.
+
+    While an arena is selected by 'arena_use', 'object_new' allocates from that arena
+    instead of the garbage-collected heap.  The selection is made separately for each thread,
+    but a single arena must not be used by more than one thread at a time.
+
+    NOTE: The garbage collector treats the contents of every arena as roots,
+          but does not know about references into an arena.
+          References to arena objects must not survive a rewind or reset.
+*/
+
+#define ARENA_CHUNK_SIZE    (64 * 1024)
+#define ARENA_ALIGN(n)      (((n) + sizeof(OOP) - 1) & ~(sizeof(OOP) - 1))
+#define arena_data(cp)      ((char *)((cp) + 1))
+
+static _Atomic(struct arena *) arena_list = NULL;  // chain of all arenas
+
+_Thread_local struct arena * arena_current = NULL;  // arena used by 'object_new' (NULL for heap)
+
+struct arena *
+arena_new()
+{
+    struct arena * arena = NEW(struct arena);
+    arena->next = atomic_load(&arena_list);
+    while (!atomic_compare_exchange_weak(&arena_list, &arena->next, arena))
+        ;
+    return arena;
+}
+
+void *
+arena_alloc(struct arena * arena, size_t size)
+{
+    struct arena_chunk * cp = arena->chunk;
+    size = ARENA_ALIGN(size);
+    if ((cp == NULL) || ((cp->used + size) > cp->size)) {
+        size_t n = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+        cp = (struct arena_chunk *)ALLOC(sizeof(struct arena_chunk) + n);
+        cp->prev = arena->chunk;
+        cp->size = n;
+        arena->chunk = cp;
+    }
+    void * p = arena_data(cp) + cp->used;
+    cp->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+struct arena_mark
+arena_mark(struct arena * arena)
+{
+    struct arena_mark mark;
+    mark.chunk = arena->chunk;
+    mark.used = (mark.chunk != NULL) ? mark.chunk->used : 0;
+    return mark;
+}
+
+/*
+    Release everything allocated from 'arena' since 'mark' was taken.
+*/
+void
+arena_rewind(struct arena * arena, struct arena_mark mark)
+{
+    while (arena->chunk != mark.chunk) {
+        struct arena_chunk * cp = arena->chunk;
+        arena->chunk = cp->prev;
+        FREE(cp);
+    }
+    if (arena->chunk != NULL) {
+        arena->chunk->used = mark.used;
+    }
+}
+
+/*
+    Release everything allocated from 'arena'.
+*/
+void
+arena_reset(struct arena * arena)
+{
+    struct arena_mark mark = { NULL, 0 };
+    arena_rewind(arena, mark);
+}
+
+size_t
+arena_used(struct arena * arena)
+{
+    size_t used = 0;
+    struct arena_chunk * cp;
+    for (cp = arena->chunk; cp != NULL; cp = cp->prev) {
+        used += cp->used;
+    }
+    return used;
+}
+
+/*
+    Apply 'mark' to every word allocated in every arena.
+*/
+void
+arena_scan(void (*mark)(OOP))
+{
+    struct arena * arena;
+    for (arena = atomic_load(&arena_list); arena != NULL; arena = arena->next) {
+        struct arena_chunk * cp;
+        for (cp = arena->chunk; cp != NULL; cp = cp->prev) {
+            OOP * word = (OOP *)arena_data(cp);
+            size_t n = cp->used / sizeof(OOP);
+            size_t i;
+            for (i = 0; i < n; ++i) {
+                (*mark)(word[i]);
+            }
+        }
+    }
+}
+
+/*
+    Direct 'object_new' to allocate from 'arena' (or the heap, if NULL), returning the previous arena.
+*/
+struct arena *
+arena_use(struct arena * arena)
+{
+    struct arena * prev = arena_current;
+    arena_current = arena;
+    return prev;
+}
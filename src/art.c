@@ -1,534 +1,1339 @@
-/*
-
-art.c -- Actor Run-Time
-
-"MIT License"
-
-Copyright (c) 2013 Dale Schumacher, Tristan Slominski
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in
-all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-THE SOFTWARE.
-
-*/
-
-#include <stdio.h>
-#include <assert.h>
-//#include <time.h>
-#include "art.h"
-#include "object.h"
-#include "pair.h"
-#include "pattern.h"
-#include "actor.h"
-#include "json.h"
-
-#undef    _ENABLE_FINGER_TREE_    /**/
-
-#ifdef _ENABLE_FINGER_TREE_
-/*
-finger:
-    Small collections of 1 to 4 items.
-   
-    o' := o.push(x)            -- return a new list with 'x' at the head
-    (x, o') := o.pop()        -- remove 'x' from the head, returning it and the new list
-    o' := o.put(x)            -- return a new list with 'x' at the tail
-    (x, o') := o.pull()        -- remove 'x' from the tail, returning it and the new list
-
-    push -> [ head ] -> pop
-            [ ...  ]
-     put -> [ tail ] -> pull
-*/
-
-struct finger {
-    struct object    o;
-    OOP                item1;
-    OOP                item2;
-    OOP                item3;
-    OOP                item4;
-};
-
-#define    as_finger(oop)    ((struct finger *)(oop))
-
-KIND(finger1_kind);
-KIND(finger2_kind);
-KIND(finger3_kind);
-KIND(finger4_kind);
-
-OOP
-finger1_new(OOP item1) {
-    struct finger * this = object_alloc(struct finger, finger1_kind);
-    this->item1 = item1;
-    return (OOP)this;
-}
-
-OOP
-finger2_new(OOP item1, OOP item2) {
-    struct finger * this = object_alloc(struct finger, finger2_kind);
-    this->item1 = item1;
-    this->item2 = item2;
-    return (OOP)this;
-}
-
-OOP
-finger3_new(OOP item1, OOP item2, OOP item3) {
-    struct finger * this = object_alloc(struct finger, finger3_kind);
-    this->item1 = item1;
-    this->item2 = item2;
-    this->item3 = item3;
-    return (OOP)this;
-}
-
-OOP
-finger4_new(OOP item1, OOP item2, OOP item3, OOP item4) {
-    struct finger * this = object_alloc(struct finger, finger4_kind);
-    this->item1 = item1;
-    this->item2 = item2;
-    this->item3 = item3;
-    this->item4 = item4;
-    return (OOP)this;
-}
-
-KIND(finger1_kind)
-{
-    if (finger1_kind == self->kind) {
-        struct finger * this = as_finger(self);
-        OOP a = this->item1;
-        OOP cmd = take_arg();
-        if (cmd == s_put) {
-            OOP x = take_arg();
-            return finger2_new(a, x);
-        } else if (cmd == s_push) {
-            OOP x = take_arg();
-            return finger2_new(x, a);
-        }
-    }
-    return o_undef;
-}
-
-KIND(finger2_kind)
-{
-    if (finger2_kind == self->kind) {
-        struct finger * this = as_finger(self);
-        OOP a = this->item1;
-        OOP b = this->item2;
-        OOP cmd = take_arg();
-        if (cmd == s_pop) {
-            return pair_new(a, finger1_new(b));
-        } else if (cmd == s_pull) {
-            return pair_new(b, finger1_new(a));
-        } else if (cmd == s_put) {
-            OOP x = take_arg();
-            return finger3_new(a, b, x);
-        } else if (cmd == s_push) {
-            OOP x = take_arg();
-            return finger3_new(x, a, b);
-        }
-    }
-    return o_undef;
-}
-
-KIND(finger3_kind)
-{
-    if (finger3_kind == self->kind) {
-        struct finger * this = as_finger(self);
-        OOP a = this->item1;
-        OOP b = this->item2;
-        OOP c = this->item3;
-        OOP cmd = take_arg();
-        if (cmd == s_pop) {
-            return pair_new(a, finger2_new(b, c));
-        } else if (cmd == s_pull) {
-            return pair_new(c, finger2_new(a, b));
-        } else if (cmd == s_put) {
-            OOP x = take_arg();
-            return finger4_new(a, b, c, x);
-        } else if (cmd == s_push) {
-            OOP x = take_arg();
-            return finger4_new(x, a, b, c);
-        }
-    }
-    return o_undef;
-}
-
-KIND(finger4_kind)
-{
-    if (finger4_kind == self->kind) {
-        struct finger * this = as_finger(self);
-        OOP a = this->item1;
-        OOP b = this->item2;
-        OOP c = this->item3;
-        OOP d = this->item4;
-        OOP cmd = take_arg();
-        if (cmd == s_pop) {
-            return pair_new(a, finger3_new(b, c, d));
-        } else if (cmd == s_pull) {
-            return pair_new(d, finger3_new(a, b, c));
-        }
-    }
-    return o_undef;
-}
-
-/*
-finger tree:
-    An efficient functional deque data-structure of arbitrary size.
-*/
-
-struct finger_tree {
-    struct object    o;
-    OOP                left;
-    OOP                mid;
-    OOP                right;
-};
-
-KIND(ft_zero_kind);
-KIND(ft_one_kind);
-KIND(ft_many_kind);
-
-struct object empty_ft = { ft_zero_kind };
-
-struct finger_tree *
-ft_one_new(OOP item) {
-    struct finger_tree * this = object_alloc(struct finger_tree, ft_one_kind);
-    this->mid = item;
-    return this;
-}
-
-struct finger_tree *
-ft_many_new(OOP left, OOP mid, OOP right) {
-    struct finger_tree * this = object_alloc(struct finger_tree, ft_many_kind);
-    this->left = left;
-    this->mid = mid;
-    this->right = right;
-    return this;
-}
-
-KIND(ft_zero_kind)
-{
-    OOP args = take_arg();
-    if (ft_zero_kind == self->kind) {
-        struct finger_tree * this = (struct finger_tree *)self;
-        if (finger2_kind == args->kind) {
-            struct finger * mfp = (struct finger *)args;
-            if (mfp->item1 == s_put) {
-                return (OOP)ft_one_new(mfp->item2);
-            }
-            if (mfp->item1 == s_push) {
-                return (OOP)ft_one_new(mfp->item2);
-            }
-        }
-    }
-    return o_undef;
-}
-
-KIND(ft_one_kind)
-{
-    OOP args = take_arg();
-    if (ft_one_kind == self->kind) {
-        struct finger_tree * this = (struct finger_tree *)self;
-        if (finger1_kind == args->kind) {
-            struct finger * mfp = (struct finger *)args;
-            if (mfp->item1 == s_pop) {
-                return pair_new(this->mid, (OOP)&empty_ft);
-            }
-            if (mfp->item1 == s_pull) {
-                return pair_new(this->mid, (OOP)&empty_ft);
-            }
-        }
-        if (finger2_kind == args->kind) {
-            struct finger * mfp = (struct finger *)args;
-            if (mfp->item1 == s_put) {
-                return (OOP)ft_many_new(
-                        (OOP)ft_one_new(this->mid), 
-                        (OOP)&empty_ft, 
-                        (OOP)ft_one_new(mfp->item2));
-            }
-            if (mfp->item1 == s_push) {
-                return (OOP)ft_many_new(
-                        (OOP)ft_one_new(mfp->item2), 
-                        (OOP)&empty_ft, 
-                        (OOP)ft_one_new(this->mid));
-            }
-        }
-    }
-    return o_undef;
-}
-
-KIND(ft_many_kind)
-{
-    OOP args = take_arg();
-    if (ft_many_kind == self->kind) {
-        struct finger_tree * this = (struct finger_tree *)self;
-        if (finger1_kind == args->kind) {
-            struct finger * mfp = (struct finger *)args;
-            if (mfp->item1 == s_pop) {
-                if (finger1_kind == this->left->kind) {
-                    struct finger * fp = (struct finger *)this->left;
-                    if (this->mid == (OOP)&empty_ft) {
-                        if (finger1_kind == this->right->kind) {
-                            struct finger * rfp = (struct finger *)this->right;
-                            return pair_new(
-                                    fp->item1,
-                                    (OOP)ft_one_new(rfp->item1));
-                        } else {
-                            struct pair * pp = (struct pair *)object_call_1(this->right, args);  // delegate to right
-                            OOP left = (OOP)finger1_new(pp->h);
-                            return pair_new(
-                                    fp->item1,
-                                    (OOP)ft_many_new(left, this->mid, pp->t));
-                        }
-                    } else {
-                        struct pair * pp = (struct pair *)object_call_1(this->mid, args);  // delegate to mid
-                        return pair_new(
-                                fp->item1,
-                                (OOP)ft_many_new(pp->h, pp->t, this->right));
-                    }
-                } else {
-                    struct pair * pp = (struct pair *)object_call_1(this->left, args);  // delegate to left
-                    return pair_new(
-                            pp->h,
-                            (OOP)ft_many_new(pp->t, this->mid, this->right));
-                }
-            }
-            if (mfp->item1 == s_pull) {
-                return o_undef; // [NOT IMPLEMENTED]
-            }
-        }
-        if (finger2_kind == args->kind) {
-            struct finger * mfp = (struct finger *)args;
-            if (mfp->item1 == s_put) {
-                if (finger4_kind == this->right->kind) {
-                    struct finger * fp = (struct finger *)this->right;
-                    OOP mid = object_call_2(this->mid,
-                            s_put, (OOP)finger3_new(fp->item1, fp->item2, fp->item3));
-                    OOP right = (OOP)finger2_new(fp->item4, mfp->item2);
-                    return (OOP)ft_many_new(this->left, mid, right);
-                } else {
-                    OOP right = object_call(this->right, args);  // delegate to right
-                    return (OOP)ft_many_new(this->left, this->mid, right);
-                }
-            }
-            if (mfp->item1 == s_push) {
-                return o_undef; // [NOT IMPLEMENTED]
-            }
-        }
-    }
-    return o_undef;
-}
-#endif /* _ENABLE_FINGER_TREE_ */
-
-/*
-    Unit tests
-*/
-void
-run_tests()
-{
-    TRACE(fprintf(stderr, "o_undef = %p\n", o_undef));
-    TRACE(fprintf(stderr, "o_fail = %p\n", o_fail));
-    TRACE(fprintf(stderr, "o_nil = %p\n", o_nil));
-
-    TRACE(fprintf(stderr, "o_true = %p\n", o_true));
-    TRACE(fprintf(stderr, "o_false = %p\n", o_false));
-    TRACE(fprintf(stderr, "s_eq_p = %p\n", s_eq_p));
-    TRACE(fprintf(stderr, "&eq_p_symbol = %p\n", &eq_p_symbol));
-    TRACE(fprintf(stderr, "symbol_kind = %p\n", (void*)symbol_kind));
-    TRACE(fprintf(stderr, "eq_p_symbol.o.kind = %p\n", (void*)eq_p_symbol.o.kind));
-    TRACE(fprintf(stderr, "eq_p_symbol.s = \"%s\"\n", eq_p_symbol.s));
-
-#ifdef _ENABLE_FINGER_TREE_
-    TRACE(fprintf(stderr, "finger1_kind = %p\n", (void*)finger1_kind));
-    TRACE(fprintf(stderr, "finger2_kind = %p\n", (void*)finger2_kind));
-    TRACE(fprintf(stderr, "finger3_kind = %p\n", (void*)finger3_kind));
-    TRACE(fprintf(stderr, "finger4_kind = %p\n", (void*)finger4_kind));
-/*
-    struct integer * ch_A = integer_new('A');
-    struct integer * ch_Z = integer_new('Z');
-    OOP ft_deque_ptr = (OOP)&empty_ft;
-    TRACE(fprintf(stderr, "&empty_ft = %p\n", &empty_ft));
-    struct integer * n_ch = ch_A;
-    struct finger * eq_fp = finger2_new(s_eq_p, (OOP)ch_Z);
-    struct finger * inc_fp = finger2_new(s_add, n_1);
-    while (object_call((OOP)n_ch, (OOP)eq_fp) != o_true) {
-        struct finger * fp = finger2_new(s_put, (OOP)n_ch);
-        TRACE(fprintf(stderr, "fp = %p\n", fp));
-        TRACE(fprintf(stderr, "finger: %p [%p %p %p %p]\n", fp->o.kind, 
-            fp->item1, fp->item2, fp->item3, fp->item4));
-        TRACE(fprintf(stderr, "ft_deque_ptr = %p ^ [%c]\n", ft_deque_ptr, n_ch->n));
-        ft_deque_ptr = object_call(ft_deque_ptr, (OOP)fp);
-        n_ch = (struct integer *)object_call((OOP)n_ch, (OOP)inc_fp);
-    }
-    n_ch = ch_A;
-    struct finger * dec_fp = finger2_new(s_add, n_minus_1);
-    struct finger * pop_fp = finger1_new(s_pop);
-    while (object_call((OOP)n_ch, (OOP)eq_fp) != o_true) {
-        struct pair * pp = (struct pair *)object_call(ft_deque_ptr, (OOP)pop_fp);
-        struct integer * ip = (struct integer *)pp->h;
-        ft_deque_ptr = pp->t;
-        TRACE(fprintf(stderr, "ft_deque_ptr = [%c] ^ %p\n", ip->n, ft_deque_ptr));
-        fp = finger2_new(s_eq_p, (OOP)n_ch);
-        result = object_call((OOP)ip, (OOP)fp);
-        assert(o_true == result);
-        n_ch = (struct integer *)object_call((OOP)n_ch, (OOP)dec_fp);
-    }
-*/    
-#endif /* _ENABLE_FINGER_TREE_ */
-
-    TRACE(fprintf(stderr, "dict_kind = %p\n", (void*)dict_kind));
-    TRACE(fprintf(stderr, "s_lookup = %p\n", s_lookup));
-    TRACE(fprintf(stderr, "s_bind = %p\n", s_bind));
-
-    OOP s_x = symbol_new("x");
-    TRACE(fprintf(stderr, "s_x = %p\n", s_x));
-    TRACE(fprintf(stderr, "as_symbol(s_x)->s = \"%s\"\n", as_symbol(s_x)->s));
-    OOP result = object_call(o_empty_dict, s_lookup, s_x);
-    TRACE(fprintf(stderr, "result = %p\n", result));
-    assert(o_fail == result);
-    
-    OOP n_42 = integer_new(42);
-    TRACE(fprintf(stderr, "n_42 = %p\n", n_42));
-    TRACE(fprintf(stderr, "as_integer(n_42)->n = %d\n", as_integer(n_42)->n));
-    OOP d_env = object_call(o_empty_dict, s_bind, s_x, n_42);
-    TRACE(fprintf(stderr, "d_env = %p\n", d_env));
-    result = object_call(d_env, s_lookup, s_x);
-    TRACE(fprintf(stderr, "result = %p\n", result));
-    assert(n_42 == result);
-
-    OOP s_y = symbol_new("y");
-    TRACE(fprintf(stderr, "s_y = %p\n", s_y));
-    TRACE(fprintf(stderr, "as_symbol(s_y)->s = \"%s\"\n", as_symbol(s_y)->s));
-    d_env = object_call(d_env, s_bind, s_y, n_minus_1);
-    TRACE(fprintf(stderr, "d_env = %p\n", d_env));
-
-    OOP s_z = symbol_new("z");
-    TRACE(fprintf(stderr, "s_z = %p\n", s_z));
-    TRACE(fprintf(stderr, "as_symbol(s_z)->s = \"%s\"\n", as_symbol(s_z)->s));
-    result = object_call(d_env, s_lookup, s_z);
-    TRACE(fprintf(stderr, "result = %p\n", result));
-    assert(o_fail == result);
-
-    OOP ch_A = integer_new('A');
-    OOP ch_Z = integer_new('Z');
-    OOP q_oop = queue_new();
-    TRACE(fprintf(stderr, "q_oop = %p\n", q_oop));
-    result = object_call(q_oop, s_empty_p);
-    assert(o_true == result);
-    OOP n_ch = ch_A;
-    while (object_call(n_ch, s_eq_p, ch_Z) != o_true) {
-        q_oop = object_call(q_oop, s_give_x, n_ch);
-        TRACE(fprintf(stderr, "q_oop = %p ^ [%c]\n", q_oop, as_integer(n_ch)->n));
-        n_ch = object_call(n_ch, s_add, n_1);
-    }
-    result = object_call(q_oop, s_empty_p);
-    assert(o_false == result);
-    n_ch = ch_A;
-    while (object_call(n_ch, s_eq_p, ch_Z) != o_true) {
-        OOP n_i = object_call(q_oop, s_take_x);
-        TRACE(fprintf(stderr, "q_oop = [%c] ^ %p\n", as_integer(n_i)->n, q_oop));
-        result = object_call(n_i, s_eq_p, n_ch);
-        assert(o_true == result);
-        n_ch = object_call(n_ch, s_add, n_1);
-    }
-    result = object_call(q_oop, s_empty_p);
-    assert(o_true == result);
-
-    TRACE(fprintf(stderr, "---- expression evaluation ----\n"));
-    TRACE(fprintf(stderr, "s_eval = %p\n", s_eval));
-    TRACE(fprintf(stderr, "s_combine = %p\n", s_combine));
-    // (\x.x)(42) -> 42
-//struct object const_42_expr = { const_expr_kind };
-//#define    expr_const_42    (&const_42_expr)
-    OOP expr_const_42 = object_alloc(struct object, const_expr_kind);
-    TRACE(fprintf(stderr, "expr_const_42 = %p\n", expr_const_42));
-    OOP expr_ident_x = ident_expr_new(s_x);
-    TRACE(fprintf(stderr, "expr_ident_x = %p\n", expr_ident_x));
-    OOP expr_example = combine_expr_new(
-        lambda_expr_new(bind_pattern_new(s_x, ptrn_all), expr_ident_x),
-        expr_const_42);
-    result = object_call(expr_example, s_eval, o_empty_dict);
-    TRACE(fprintf(stderr, "result = %p\n", result));
-    assert(expr_const_42 == result);
-    // (\[x, y].y)([0, 1]) -> 1
-    // (($lambda (x y) y) ($quote (0 1))) -> 1
-    // (($lambda (x y) y) (list 0 1))) -> 1
-    TRACE(fprintf(stderr, "n_0 = %p\n", n_0));
-    TRACE(fprintf(stderr, "n_1 = %p\n", n_1));
-    OOP ptrn_parm_x_y = and_pattern_new(
-        bind_pattern_new(s_x, ptrn_any),
-        and_pattern_new(
-            bind_pattern_new(s_y, ptrn_any),
-            ptrn_end));
-    OOP list_0_1 = pair_new(n_0, pair_new(n_1, o_nil));
-    expr_example = combine_expr_new(
-        lambda_expr_new(
-            ptrn_parm_x_y, 
-            ident_expr_new(s_y)),
-        quote_expr_new(list_0_1));
-    result = object_call(expr_example, s_eval, o_empty_dict);
-    TRACE(fprintf(stderr, "result = %p\n", result));
-    assert(n_1 == result);
-
-    TRACE(fprintf(stderr, "---- actor primitives ----\n"));
-    TRACE(fprintf(stderr, "s_create_x = %p\n", s_create_x));
-    TRACE(fprintf(stderr, "s_send_x = %p\n", s_send_x));
-    TRACE(fprintf(stderr, "s_become_x = %p\n", s_become_x));
-    TRACE(fprintf(stderr, "s_dispatch_x = %p\n", s_dispatch_x));
-    OOP cfg = config_new();
-    // dispatch empty queue
-    result = object_call(cfg, s_dispatch_x, n_0);
-    TRACE(fprintf(stderr, "result = %p\n", result));
-    assert(o_true == object_call(result, s_eq_p, n_0));
-    // enqueue test event(s)
-//    OOP a_fwd = actor_new(forward_beh_new(a_sink));
-    OOP a_fwd = actor_new(one_shot_beh_new(a_sink));
-    TRACE(fprintf(stderr, "a_fwd = %p\n", a_fwd));
-    OOP event = event_new(a_fwd, n_42);
-    TRACE(fprintf(stderr, "event = %p\n", event));
-    result = object_call(cfg, s_give_x, event);
-    TRACE(fprintf(stderr, "result = %p\n", result));
-    assert(o_true == object_call(result, s_eq_p, n_1));
-    event = event_new(a_fwd, n_1);
-    TRACE(fprintf(stderr, "event = %p\n", event));
-    result = object_call(cfg, s_give_x, event);
-    TRACE(fprintf(stderr, "result = %p\n", result));
-    assert(o_true == object_call(result, s_eq_p, n_2));
-    // dispatch up to 5 events
-    OOP n_5 = integer_new(5);
-    result = object_call(cfg, s_dispatch_x, n_5);
-    TRACE(fprintf(stderr, "result = %p\n", result));
-    assert(o_true == object_call(result, s_eq_p, n_0));
-    
-    TRACE(fprintf(stderr, "---- json parser ----\n"));
-    OOP g_json = json_grammar_new();
-    TRACE(fprintf(stderr, "g_json = %p\n", g_json));
-//    OOP s_src = string_stream_new("null");
-    OOP s_src = string_stream_new(" [0, {\"N\":42}, true]\n");
-    TRACE(fprintf(stderr, "s_src = %p\n", s_src));    
-    OOP match = match_new(s_src, o_empty_dict, o_undef);
-    TRACE(fprintf(stderr, "match = %p\n", match));
-    match = object_call(g_json, s_match, match);
-    TRACE(fprintf(stderr, "match' = %p\n", match));
-    assert(match_kind == match->kind);
-}
-
-/*
-    Main entry-point
-*/
-int
-main()
-{
-    run_tests();
-    return 0;
-}
+/*
+
+art.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stdio.h>
+#include <assert.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/socket.h>
+//#include <time.h>
+#include "art.h"
+#include "object.h"
+#include "pair.h"
+#include "pattern.h"
+#include "actor.h"
+#include "json.h"
+#include "gc.h"
+#include "arena.h"
+#include "pconfig.h"
+#include "shard.h"
+#include "remote.h"
+#include "pvm.h"
+
+#undef    _ENABLE_FINGER_TREE_    /**/
+
+#ifdef _ENABLE_FINGER_TREE_
+/*
+finger:
+    Small collections of 1 to 4 items.
+   
+    o' := o.push(x)            -- return a new list with 'x' at the head
+    (x, o') := o.pop()        -- remove 'x' from the head, returning it and the new list
+    o' := o.put(x)            -- return a new list with 'x' at the tail
+    (x, o') := o.pull()        -- remove 'x' from the tail, returning it and the new list
+
+    push -> [ head ] -> pop
+            [ ...  ]
+     put -> [ tail ] -> pull
+*/
+
+struct finger {
+    struct object    o;
+    OOP                item1;
+    OOP                item2;
+    OOP                item3;
+    OOP                item4;
+};
+
+#define    as_finger(oop)    ((struct finger *)(oop))
+
+KIND(finger1_kind);
+KIND(finger2_kind);
+KIND(finger3_kind);
+KIND(finger4_kind);
+
+OOP
+finger1_new(OOP item1) {
+    struct finger * this = object_alloc(struct finger, finger1_kind);
+    this->item1 = item1;
+    return (OOP)this;
+}
+
+OOP
+finger2_new(OOP item1, OOP item2) {
+    struct finger * this = object_alloc(struct finger, finger2_kind);
+    this->item1 = item1;
+    this->item2 = item2;
+    return (OOP)this;
+}
+
+OOP
+finger3_new(OOP item1, OOP item2, OOP item3) {
+    struct finger * this = object_alloc(struct finger, finger3_kind);
+    this->item1 = item1;
+    this->item2 = item2;
+    this->item3 = item3;
+    return (OOP)this;
+}
+
+OOP
+finger4_new(OOP item1, OOP item2, OOP item3, OOP item4) {
+    struct finger * this = object_alloc(struct finger, finger4_kind);
+    this->item1 = item1;
+    this->item2 = item2;
+    this->item3 = item3;
+    this->item4 = item4;
+    return (OOP)this;
+}
+
+KIND(finger1_kind)
+{
+    if (finger1_kind == self->kind) {
+        struct finger * this = as_finger(self);
+        OOP a = this->item1;
+        OOP cmd = take_arg();
+        if (cmd == s_put) {
+            OOP x = take_arg();
+            return finger2_new(a, x);
+        } else if (cmd == s_push) {
+            OOP x = take_arg();
+            return finger2_new(x, a);
+        }
+    }
+    return o_undef;
+}
+
+KIND(finger2_kind)
+{
+    if (finger2_kind == self->kind) {
+        struct finger * this = as_finger(self);
+        OOP a = this->item1;
+        OOP b = this->item2;
+        OOP cmd = take_arg();
+        if (cmd == s_pop) {
+            return pair_new(a, finger1_new(b));
+        } else if (cmd == s_pull) {
+            return pair_new(b, finger1_new(a));
+        } else if (cmd == s_put) {
+            OOP x = take_arg();
+            return finger3_new(a, b, x);
+        } else if (cmd == s_push) {
+            OOP x = take_arg();
+            return finger3_new(x, a, b);
+        }
+    }
+    return o_undef;
+}
+
+KIND(finger3_kind)
+{
+    if (finger3_kind == self->kind) {
+        struct finger * this = as_finger(self);
+        OOP a = this->item1;
+        OOP b = this->item2;
+        OOP c = this->item3;
+        OOP cmd = take_arg();
+        if (cmd == s_pop) {
+            return pair_new(a, finger2_new(b, c));
+        } else if (cmd == s_pull) {
+            return pair_new(c, finger2_new(a, b));
+        } else if (cmd == s_put) {
+            OOP x = take_arg();
+            return finger4_new(a, b, c, x);
+        } else if (cmd == s_push) {
+            OOP x = take_arg();
+            return finger4_new(x, a, b, c);
+        }
+    }
+    return o_undef;
+}
+
+KIND(finger4_kind)
+{
+    if (finger4_kind == self->kind) {
+        struct finger * this = as_finger(self);
+        OOP a = this->item1;
+        OOP b = this->item2;
+        OOP c = this->item3;
+        OOP d = this->item4;
+        OOP cmd = take_arg();
+        if (cmd == s_pop) {
+            return pair_new(a, finger3_new(b, c, d));
+        } else if (cmd == s_pull) {
+            return pair_new(d, finger3_new(a, b, c));
+        }
+    }
+    return o_undef;
+}
+
+/*
+finger tree:
+    An efficient functional deque data-structure of arbitrary size.
+*/
+
+struct finger_tree {
+    struct object    o;
+    OOP                left;
+    OOP                mid;
+    OOP                right;
+};
+
+KIND(ft_zero_kind);
+KIND(ft_one_kind);
+KIND(ft_many_kind);
+
+struct object empty_ft = { ft_zero_kind };
+
+struct finger_tree *
+ft_one_new(OOP item) {
+    struct finger_tree * this = object_alloc(struct finger_tree, ft_one_kind);
+    this->mid = item;
+    return this;
+}
+
+struct finger_tree *
+ft_many_new(OOP left, OOP mid, OOP right) {
+    struct finger_tree * this = object_alloc(struct finger_tree, ft_many_kind);
+    this->left = left;
+    this->mid = mid;
+    this->right = right;
+    return this;
+}
+
+KIND(ft_zero_kind)
+{
+    OOP args = take_arg();
+    if (ft_zero_kind == self->kind) {
+        struct finger_tree * this = (struct finger_tree *)self;
+        if (finger2_kind == args->kind) {
+            struct finger * mfp = (struct finger *)args;
+            if (mfp->item1 == s_put) {
+                return (OOP)ft_one_new(mfp->item2);
+            }
+            if (mfp->item1 == s_push) {
+                return (OOP)ft_one_new(mfp->item2);
+            }
+        }
+    }
+    return o_undef;
+}
+
+KIND(ft_one_kind)
+{
+    OOP args = take_arg();
+    if (ft_one_kind == self->kind) {
+        struct finger_tree * this = (struct finger_tree *)self;
+        if (finger1_kind == args->kind) {
+            struct finger * mfp = (struct finger *)args;
+            if (mfp->item1 == s_pop) {
+                return pair_new(this->mid, (OOP)&empty_ft);
+            }
+            if (mfp->item1 == s_pull) {
+                return pair_new(this->mid, (OOP)&empty_ft);
+            }
+        }
+        if (finger2_kind == args->kind) {
+            struct finger * mfp = (struct finger *)args;
+            if (mfp->item1 == s_put) {
+                return (OOP)ft_many_new(
+                        (OOP)ft_one_new(this->mid), 
+                        (OOP)&empty_ft, 
+                        (OOP)ft_one_new(mfp->item2));
+            }
+            if (mfp->item1 == s_push) {
+                return (OOP)ft_many_new(
+                        (OOP)ft_one_new(mfp->item2), 
+                        (OOP)&empty_ft, 
+                        (OOP)ft_one_new(this->mid));
+            }
+        }
+    }
+    return o_undef;
+}
+
+KIND(ft_many_kind)
+{
+    OOP args = take_arg();
+    if (ft_many_kind == self->kind) {
+        struct finger_tree * this = (struct finger_tree *)self;
+        if (finger1_kind == args->kind) {
+            struct finger * mfp = (struct finger *)args;
+            if (mfp->item1 == s_pop) {
+                if (finger1_kind == this->left->kind) {
+                    struct finger * fp = (struct finger *)this->left;
+                    if (this->mid == (OOP)&empty_ft) {
+                        if (finger1_kind == this->right->kind) {
+                            struct finger * rfp = (struct finger *)this->right;
+                            return pair_new(
+                                    fp->item1,
+                                    (OOP)ft_one_new(rfp->item1));
+                        } else {
+                            struct pair * pp = (struct pair *)object_call_1(this->right, args);  // delegate to right
+                            OOP left = (OOP)finger1_new(pp->h);
+                            return pair_new(
+                                    fp->item1,
+                                    (OOP)ft_many_new(left, this->mid, pp->t));
+                        }
+                    } else {
+                        struct pair * pp = (struct pair *)object_call_1(this->mid, args);  // delegate to mid
+                        return pair_new(
+                                fp->item1,
+                                (OOP)ft_many_new(pp->h, pp->t, this->right));
+                    }
+                } else {
+                    struct pair * pp = (struct pair *)object_call_1(this->left, args);  // delegate to left
+                    return pair_new(
+                            pp->h,
+                            (OOP)ft_many_new(pp->t, this->mid, this->right));
+                }
+            }
+            if (mfp->item1 == s_pull) {
+                return o_undef; // [NOT IMPLEMENTED]
+            }
+        }
+        if (finger2_kind == args->kind) {
+            struct finger * mfp = (struct finger *)args;
+            if (mfp->item1 == s_put) {
+                if (finger4_kind == this->right->kind) {
+                    struct finger * fp = (struct finger *)this->right;
+                    OOP mid = object_call_2(this->mid,
+                            s_put, (OOP)finger3_new(fp->item1, fp->item2, fp->item3));
+                    OOP right = (OOP)finger2_new(fp->item4, mfp->item2);
+                    return (OOP)ft_many_new(this->left, mid, right);
+                } else {
+                    OOP right = object_call(this->right, args);  // delegate to right
+                    return (OOP)ft_many_new(this->left, this->mid, right);
+                }
+            }
+            if (mfp->item1 == s_push) {
+                return o_undef; // [NOT IMPLEMENTED]
+            }
+        }
+    }
+    return o_undef;
+}
+#endif /* _ENABLE_FINGER_TREE_ */
+
+/*
+    Counting behavior (counts messages without synchronization, relying on actor serialization)
+*/
+struct count_beh {
+    struct object   o;
+    int             n;          // number of messages received
+};
+
+KIND(count_beh_kind)
+{
+    struct count_beh * this = (struct count_beh *)self;
+    OOP evt = take_arg();
+    TRACE(fprintf(stderr, "%p count_beh_kind {n:%d} event=%p\n", this, this->n, evt));
+    int n = this->n;
+    sched_yield();  // invite interference
+    this->n = n + 1;
+    return o_true;  // commit
+}
+
+/*
+    Recording behavior (remembers the messages received, most recent first)
+*/
+struct record_beh {
+    struct object   o;
+    OOP             log;        // list of messages received
+};
+
+KIND(record_beh_kind)
+{
+    struct record_beh * this = (struct record_beh *)self;
+    OOP evt = take_arg();
+    this->log = pair_new(as_event(evt)->msg, this->log);
+    return o_true;  // commit
+}
+
+/*
+    Burst behavior (sends each message in a list to 'target')
+*/
+struct burst_beh {
+    struct object   o;
+    OOP             target;     // actor to send messages to
+    OOP             msgs;       // list of messages to send
+};
+
+KIND(burst_beh_kind)
+{
+    struct burst_beh * this = (struct burst_beh *)self;
+    OOP evt = take_arg();
+    OOP msgs;
+    for (msgs = this->msgs; o_nil != msgs; msgs = as_pair(msgs)->t) {
+        object_call(evt, s_send_x, this->target, as_pair(msgs)->h);
+    }
+    return o_true;  // commit
+}
+
+/*
+    Binding behavior (binds its message in 'scope', then aborts)
+*/
+struct bind_beh {
+    struct object   o;
+    OOP             scope;      // scope to bind in
+};
+
+KIND(bind_beh_kind)
+{
+    struct bind_beh * this = (struct bind_beh *)self;
+    OOP evt = take_arg();
+    object_call(this->scope, s_bind, as_event(evt)->msg, n_1);
+    return o_false;  // abort
+}
+
+/*
+    Parsing behavior (matches 'ptrn' against a new string stream, then aborts)
+*/
+struct parse_beh {
+    struct object   o;
+    OOP             ptrn;       // pattern to match
+};
+
+KIND(parse_beh_kind)
+{
+    struct parse_beh * this = (struct parse_beh *)self;
+    OOP evt = take_arg();
+    OOP match = match_new(string_stream_new("123"), o_empty_dict, as_event(evt)->msg);
+    object_call(this->ptrn, s_match, match);
+    return o_false;  // abort
+}
+
+/*
+    Keeping behavior (remembers the event it was given, and forwards its message to 'target')
+*/
+struct keep_beh {
+    struct object   o;
+    OOP             target;     // actor to forward to
+    OOP             kept;       // the event last given
+};
+
+KIND(keep_beh_kind)
+{
+    struct keep_beh * this = (struct keep_beh *)self;
+    OOP evt = take_arg();
+    this->kept = evt;
+    object_call(evt, s_send_x, this->target, as_event(evt)->msg);
+    return o_true;  // commit
+}
+
+/*
+    Aborting behavior (creates actors and sends messages, then aborts)
+*/
+KIND(abort_beh_kind)
+{
+    OOP evt = take_arg();
+    int i;
+    for (i = 0; i < 3; ++i) {
+        OOP actor = object_call(evt, s_create_x, beh_empty);
+        object_call(evt, s_send_x, actor, integer_new(i));
+    }
+    return o_false;  // abort
+}
+
+struct object abort_beh = { abort_beh_kind };
+
+/*
+    Compare two values, looking inside pairs
+*/
+int
+same_value(OOP a, OOP b)
+{
+    while ((a != b) && (pair_kind == kind_of(a)) && (pair_kind == kind_of(b))) {
+        if (!same_value(as_pair(a)->h, as_pair(b)->h)) {
+            return 0;
+        }
+        a = as_pair(a)->t;
+        b = as_pair(b)->t;
+    }
+    return (a == b);
+}
+
+/*
+    Run two bursts into one recorder on 'config', returning the log of the recorder
+*/
+OOP
+burst_test(OOP config)
+{
+    struct record_beh * b_rec = object_alloc(struct record_beh, record_beh_kind);
+    b_rec->log = o_nil;
+    OOP a_rec = actor_new((OOP)b_rec);
+    OOP msgs = o_nil;
+    int i;
+    for (i = 10; i > 0; --i) {
+        msgs = pair_new(integer_new(i), msgs);
+    }
+    struct burst_beh * b_burst = object_alloc(struct burst_beh, burst_beh_kind);
+    b_burst->target = a_rec;
+    b_burst->msgs = msgs;
+    object_call(config, s_give_x, event_new(actor_new((OOP)b_burst), o_nil));
+    object_call(config, s_give_x, event_new(actor_new((OOP)b_burst), o_nil));
+    OOP result = object_call(config, s_dispatch_x, integer_new(100));
+    assert(n_0 == result);
+    return b_rec->log;
+}
+
+/*
+    Unit tests
+*/
+void
+run_tests()
+{
+    TRACE(fprintf(stderr, "o_undef = %p\n", o_undef));
+    TRACE(fprintf(stderr, "o_fail = %p\n", o_fail));
+    TRACE(fprintf(stderr, "o_nil = %p\n", o_nil));
+
+    TRACE(fprintf(stderr, "o_true = %p\n", o_true));
+    TRACE(fprintf(stderr, "o_false = %p\n", o_false));
+    TRACE(fprintf(stderr, "s_eq_p = %p\n", s_eq_p));
+    TRACE(fprintf(stderr, "&eq_p_symbol = %p\n", &eq_p_symbol));
+    TRACE(fprintf(stderr, "symbol_kind = %p\n", (void*)symbol_kind));
+    TRACE(fprintf(stderr, "eq_p_symbol.o.kind = %p\n", (void*)eq_p_symbol.o.kind));
+    TRACE(fprintf(stderr, "eq_p_symbol.s = \"%s\"\n", eq_p_symbol.s));
+
+#ifdef _ENABLE_FINGER_TREE_
+    TRACE(fprintf(stderr, "finger1_kind = %p\n", (void*)finger1_kind));
+    TRACE(fprintf(stderr, "finger2_kind = %p\n", (void*)finger2_kind));
+    TRACE(fprintf(stderr, "finger3_kind = %p\n", (void*)finger3_kind));
+    TRACE(fprintf(stderr, "finger4_kind = %p\n", (void*)finger4_kind));
+/*
+    struct integer * ch_A = integer_new('A');
+    struct integer * ch_Z = integer_new('Z');
+    OOP ft_deque_ptr = (OOP)&empty_ft;
+    TRACE(fprintf(stderr, "&empty_ft = %p\n", &empty_ft));
+    struct integer * n_ch = ch_A;
+    struct finger * eq_fp = finger2_new(s_eq_p, (OOP)ch_Z);
+    struct finger * inc_fp = finger2_new(s_add, n_1);
+    while (object_call((OOP)n_ch, (OOP)eq_fp) != o_true) {
+        struct finger * fp = finger2_new(s_put, (OOP)n_ch);
+        TRACE(fprintf(stderr, "fp = %p\n", fp));
+        TRACE(fprintf(stderr, "finger: %p [%p %p %p %p]\n", fp->o.kind, 
+            fp->item1, fp->item2, fp->item3, fp->item4));
+        TRACE(fprintf(stderr, "ft_deque_ptr = %p ^ [%c]\n", ft_deque_ptr, n_ch->n));
+        ft_deque_ptr = object_call(ft_deque_ptr, (OOP)fp);
+        n_ch = (struct integer *)object_call((OOP)n_ch, (OOP)inc_fp);
+    }
+    n_ch = ch_A;
+    struct finger * dec_fp = finger2_new(s_add, n_minus_1);
+    struct finger * pop_fp = finger1_new(s_pop);
+    while (object_call((OOP)n_ch, (OOP)eq_fp) != o_true) {
+        struct pair * pp = (struct pair *)object_call(ft_deque_ptr, (OOP)pop_fp);
+        struct integer * ip = (struct integer *)pp->h;
+        ft_deque_ptr = pp->t;
+        TRACE(fprintf(stderr, "ft_deque_ptr = [%c] ^ %p\n", ip->n, ft_deque_ptr));
+        fp = finger2_new(s_eq_p, (OOP)n_ch);
+        result = object_call((OOP)ip, (OOP)fp);
+        assert(o_true == result);
+        n_ch = (struct integer *)object_call((OOP)n_ch, (OOP)dec_fp);
+    }
+*/    
+#endif /* _ENABLE_FINGER_TREE_ */
+
+    TRACE(fprintf(stderr, "dict_kind = %p\n", (void*)dict_kind));
+    TRACE(fprintf(stderr, "s_lookup = %p\n", s_lookup));
+    TRACE(fprintf(stderr, "s_bind = %p\n", s_bind));
+
+    OOP s_x = symbol_new("x");
+    TRACE(fprintf(stderr, "s_x = %p\n", s_x));
+    TRACE(fprintf(stderr, "as_symbol(s_x)->s = \"%s\"\n", as_symbol(s_x)->s));
+    OOP result = object_call(o_empty_dict, s_lookup, s_x);
+    TRACE(fprintf(stderr, "result = %p\n", result));
+    assert(o_fail == result);
+    
+    OOP n_42 = integer_new(42);
+    TRACE(fprintf(stderr, "n_42 = %p\n", n_42));
+    TRACE(fprintf(stderr, "integer_value(n_42) = %d\n", integer_value(n_42)));
+    OOP d_env = object_call(o_empty_dict, s_bind, s_x, n_42);
+    TRACE(fprintf(stderr, "d_env = %p\n", d_env));
+    result = object_call(d_env, s_lookup, s_x);
+    TRACE(fprintf(stderr, "result = %p\n", result));
+    assert(n_42 == result);
+
+    OOP s_y = symbol_new("y");
+    TRACE(fprintf(stderr, "s_y = %p\n", s_y));
+    TRACE(fprintf(stderr, "as_symbol(s_y)->s = \"%s\"\n", as_symbol(s_y)->s));
+    d_env = object_call(d_env, s_bind, s_y, n_minus_1);
+    TRACE(fprintf(stderr, "d_env = %p\n", d_env));
+
+    OOP s_z = symbol_new("z");
+    TRACE(fprintf(stderr, "s_z = %p\n", s_z));
+    TRACE(fprintf(stderr, "as_symbol(s_z)->s = \"%s\"\n", as_symbol(s_z)->s));
+    result = object_call(d_env, s_lookup, s_z);
+    TRACE(fprintf(stderr, "result = %p\n", result));
+    assert(o_fail == result);
+    assert(SEL_LOOKUP == selector_of(s_lookup));
+    assert(SEL_NONE == selector_of(s_z));
+    assert(SEL_NONE == selector_of(n_42));
+    assert(s_x == symbol_new("x"));  // interned
+    assert(s_y == symbol_new_n("yz", 1));
+    assert(s_z != symbol_new_n("zz", 2));
+    result = object_call(d_env, s_lookup, symbol_new("x"));
+    assert(n_42 == result);
+
+    OOP h_env = object_call(o_empty_hamt, s_bind, s_x, n_42);
+    OOP h_env_1 = object_call(h_env, s_bind, s_y, n_minus_1);
+    assert(n_42 == object_call(h_env_1, s_lookup, s_x));
+    assert(n_minus_1 == object_call(h_env_1, s_lookup, s_y));
+    assert(o_fail == object_call(h_env, s_lookup, s_y));  // persistent
+    assert(o_fail == object_call(h_env_1, s_lookup, s_z));
+    h_env_1 = object_call(h_env_1, s_bind, s_x, n_0);
+    assert(n_0 == object_call(h_env_1, s_lookup, s_x));
+    assert(n_42 == object_call(h_env, s_lookup, s_x));
+    char k_name[16];
+    int k;
+    for (k = 0; k < 1000; ++k) {
+        sprintf(k_name, "k%d", k);
+        h_env_1 = object_call(h_env_1, s_bind, symbol_new(k_name), integer_new(k));
+    }
+    for (k = 0; k < 1000; ++k) {
+        sprintf(k_name, "k%d", k);
+        assert(integer_new(k) == object_call(h_env_1, s_lookup, symbol_new(k_name)));
+    }
+    assert(o_fail == object_call(h_env_1, s_lookup, symbol_new("k1000")));
+    assert(n_minus_1 == object_call(h_env_1, s_lookup, s_y));
+    result = object_call(d_env, s_z);  // not understood
+    assert(o_undef == result);
+
+    OOP ch_A = integer_new('A');
+    OOP ch_Z = integer_new('Z');
+    OOP q_oop = queue_new();
+    TRACE(fprintf(stderr, "q_oop = %p\n", q_oop));
+    result = object_call(q_oop, s_empty_p);
+    assert(o_true == result);
+    OOP n_ch = ch_A;
+    while (object_call(n_ch, s_eq_p, ch_Z) != o_true) {
+        q_oop = object_call(q_oop, s_give_x, n_ch);
+        TRACE(fprintf(stderr, "q_oop = %p ^ [%c]\n", q_oop, integer_value(n_ch)));
+        n_ch = object_call(n_ch, s_add, n_1);
+    }
+    result = object_call(q_oop, s_empty_p);
+    assert(o_false == result);
+    n_ch = ch_A;
+    while (object_call(n_ch, s_eq_p, ch_Z) != o_true) {
+        OOP n_i = object_call(q_oop, s_take_x);
+        TRACE(fprintf(stderr, "q_oop = [%c] ^ %p\n", integer_value(n_i), q_oop));
+        result = object_call(n_i, s_eq_p, n_ch);
+        assert(o_true == result);
+        n_ch = object_call(n_ch, s_add, n_1);
+    }
+    result = object_call(q_oop, s_empty_p);
+    assert(o_true == result);
+
+    assert(is_fixnum(n_42));
+    assert(integer_new(42) == n_42);  // immediate values compare by identity
+    size_t n_heap = gc_count();
+    result = object_call(n_42, s_add, n_minus_1);
+    assert(integer_value(result) == 41);
+    assert(gc_count() == n_heap);  // no allocation
+    assert(o_true == object_call1(n_42, s_eq_p, integer_new(42)));  // fixed-arity send
+    assert(INT_MAX == integer_value(integer_new(INT_MAX)));  // boxed, if wider than a fixnum
+    assert(INT_MIN == integer_value(integer_new(INT_MIN)));
+    assert(o_true == object_call(integer_new(INT_MAX), s_eq_p, integer_new(INT_MAX)));
+    assert(INT_MAX == integer_value(object_call(integer_new(INT_MAX - 1), s_add, n_1)));
+    OOP p_excl = exclset_p_new("\"\\");  // complement of a bitmap
+    assert(o_true == object_call0(p_excl, integer_new('a')));
+    assert(o_false == object_call0(p_excl, integer_new('"')));
+    static const struct charset_range greek[] = { { 0xB5, 0xB5 }, { 0x391, 0x3A9 }, { 0x3B1, 0x3C9 } };
+    OOP p_greek = charset_p_range_new("_", greek, 3);
+    assert(o_true == object_call0(p_greek, integer_new('_')));
+    assert(o_true == object_call0(p_greek, integer_new(0xB5)));  // range below 256, in the bitmap
+    assert(o_true == object_call0(p_greek, integer_new(-0x4B)));  // same byte, from a signed char
+    assert(o_true == object_call0(p_greek, integer_new(0x3A9)));
+    assert(o_false == object_call0(p_greek, integer_new(0x3AA)));
+    assert(o_false == object_call0(p_greek, integer_new('a')));
+    p_excl = exclset_p_range_new("", greek, 3);
+    assert(o_false == object_call0(p_excl, integer_new(0x3B1)));
+    assert(o_true == object_call0(p_excl, integer_new(0x3B0)));
+
+    TRACE(fprintf(stderr, "---- expression evaluation ----\n"));
+    TRACE(fprintf(stderr, "s_eval = %p\n", s_eval));
+    TRACE(fprintf(stderr, "s_combine = %p\n", s_combine));
+    // (\x.x)(42) -> 42
+//struct object const_42_expr = { const_expr_kind };
+//#define    expr_const_42    (&const_42_expr)
+    OOP expr_const_42 = object_alloc(struct object, const_expr_kind);
+    TRACE(fprintf(stderr, "expr_const_42 = %p\n", expr_const_42));
+    OOP expr_ident_x = ident_expr_new(s_x);
+    TRACE(fprintf(stderr, "expr_ident_x = %p\n", expr_ident_x));
+    OOP expr_example = combine_expr_new(
+        lambda_expr_new(bind_pattern_new(s_x, ptrn_all), expr_ident_x),
+        expr_const_42);
+    result = object_call(expr_example, s_eval, o_empty_dict);
+    TRACE(fprintf(stderr, "result = %p\n", result));
+    assert(expr_const_42 == result);
+    // (\[x, y].y)([0, 1]) -> 1
+    // (($lambda (x y) y) ($quote (0 1))) -> 1
+    // (($lambda (x y) y) (list 0 1))) -> 1
+    TRACE(fprintf(stderr, "n_0 = %p\n", n_0));
+    TRACE(fprintf(stderr, "n_1 = %p\n", n_1));
+    OOP ptrn_parm_x_y = and_pattern_new(
+        bind_pattern_new(s_x, ptrn_any),
+        and_pattern_new(
+            bind_pattern_new(s_y, ptrn_any),
+            ptrn_end));
+    OOP list_0_1 = pair_new(n_0, pair_new(n_1, o_nil));
+    expr_example = combine_expr_new(
+        lambda_expr_new(
+            ptrn_parm_x_y, 
+            ident_expr_new(s_y)),
+        quote_expr_new(list_0_1));
+    result = object_call(expr_example, s_eval, o_empty_dict);
+    TRACE(fprintf(stderr, "result = %p\n", result));
+    assert(n_1 == result);
+
+    TRACE(fprintf(stderr, "---- actor primitives ----\n"));
+    TRACE(fprintf(stderr, "s_create_x = %p\n", s_create_x));
+    TRACE(fprintf(stderr, "s_send_x = %p\n", s_send_x));
+    TRACE(fprintf(stderr, "s_become_x = %p\n", s_become_x));
+    TRACE(fprintf(stderr, "s_dispatch_x = %p\n", s_dispatch_x));
+    OOP cfg = config_new();
+    // dispatch empty queue
+    result = object_call(cfg, s_dispatch_x, n_0);
+    TRACE(fprintf(stderr, "result = %p\n", result));
+    assert(o_true == object_call(result, s_eq_p, n_0));
+    // enqueue test event(s)
+//    OOP a_fwd = actor_new(forward_beh_new(a_sink));
+    OOP a_fwd = actor_new(one_shot_beh_new(a_sink));
+    TRACE(fprintf(stderr, "a_fwd = %p\n", a_fwd));
+    OOP event = event_new(a_fwd, n_42);
+    TRACE(fprintf(stderr, "event = %p\n", event));
+    result = object_call(cfg, s_give_x, event);
+    TRACE(fprintf(stderr, "result = %p\n", result));
+    assert(o_true == object_call(result, s_eq_p, n_1));
+    event = event_new(a_fwd, n_1);
+    TRACE(fprintf(stderr, "event = %p\n", event));
+    result = object_call(cfg, s_give_x, event);
+    TRACE(fprintf(stderr, "result = %p\n", result));
+    assert(o_true == object_call(result, s_eq_p, n_2));
+    // dispatch up to 5 events
+    OOP n_5 = integer_new(5);
+    result = object_call(cfg, s_dispatch_x, n_5);
+    TRACE(fprintf(stderr, "result = %p\n", result));
+    assert(o_true == object_call(result, s_eq_p, n_0));
+    OOP l_events = o_nil;
+    for (k = 0; k < 100; ++k) {
+        l_events = pair_new(event_new(a_sink, integer_new(k)), l_events);
+    }
+    object_call(cfg, s_give_x, event_new(a_sink, n_0));
+    result = object_call(cfg, s_give_all_x, l_events);  // grows the event ring
+    assert(integer_new(101) == result);
+    result = object_call(cfg, s_dispatch_x, n_5);
+    assert(integer_new(96) == result);
+    result = object_call(cfg, s_dispatch_x, integer_new(200));
+    assert(n_0 == result);
+    OOP l_log = burst_test(cfg);
+    for (k = 20; k > 0; --k) {  // each burst in send order, one after the other
+        assert(integer_new(((k - 1) % 10) + 1) == as_pair(l_log)->h);
+        l_log = as_pair(l_log)->t;
+    }
+    OOP a_abort = actor_new(&abort_beh);
+    object_call(cfg, s_give_x, event_new(a_abort, n_0));
+    n_heap = gc_count();
+    result = object_call(cfg, s_dispatch_x, n_1);
+    assert(n_0 == result);  // nothing sent
+    assert(n_heap == gc_count());  // nothing kept
+    assert(&abort_beh == as_actor(a_abort)->beh);
+    OOP sponsor = sponsor_new(15, 1000, 100000);
+    gc_root(&sponsor);
+    struct record_beh * b_rec_s = object_alloc(struct record_beh, record_beh_kind);
+    b_rec_s->log = o_nil;
+    struct burst_beh * b_burst_s = object_alloc(struct burst_beh, burst_beh_kind);
+    b_burst_s->target = actor_new((OOP)b_rec_s);
+    b_burst_s->msgs = l_events;  // 100 messages
+    OOP a_burst_s = actor_new((OOP)b_burst_s);
+    event = event_new(a_burst_s, n_1);
+    as_event(event)->sponsor = sponsor;
+    object_call(cfg, s_give_x, event);
+    result = object_call(cfg, s_dispatch_x, n_5);
+    assert(n_0 == result);  // aborted, and held
+    assert(as_sponsor(sponsor)->suspended);
+    assert(15 == as_sponsor(sponsor)->messages);  // refunded
+    event = event_new(a_burst_s, n_2);
+    as_event(event)->sponsor = sponsor;
+    object_call(cfg, s_give_x, event);
+    result = object_call(cfg, s_dispatch_x, n_5);
+    assert(n_0 == result);  // held
+    result = sponsor_refill(sponsor, cfg, 100, 0, 0);
+    assert(n_2 == result);  // both events resume
+    result = object_call(cfg, s_dispatch_x, integer_new(200));
+    assert(n_0 == result);
+    assert(as_sponsor(sponsor)->suspended);  // the second burst exhausted it again
+    assert(15 == as_sponsor(sponsor)->messages);
+    assert(as_sponsor(sponsor)->allocs < 1000);
+    result = sponsor_refill(sponsor, cfg, 100, 0, 0);
+    assert(integer_new(101) == result);  // the second burst, and the messages from the first
+    result = object_call(cfg, s_dispatch_x, integer_new(1000));
+    assert(n_0 == result);
+    for (k = 0; k < 200; ++k) {  // no burst lost
+        assert(o_nil != b_rec_s->log);
+        b_rec_s->log = as_pair(b_rec_s->log)->t;
+    }
+    assert(o_nil == b_rec_s->log);
+    struct record_beh * b_rec_h = object_alloc(struct record_beh, record_beh_kind);
+    b_rec_h->log = o_nil;
+    OOP a_chain = actor_new((OOP)b_rec_h);
+    for (k = 0; k < 20; ++k) {  // longer than one run of handoffs
+        a_chain = actor_new(forward_beh_new(a_chain));
+    }
+    struct keep_beh * b_keep = object_alloc(struct keep_beh, keep_beh_kind);
+    b_keep->target = a_chain;
+    OOP a_keep = actor_new((OOP)b_keep);
+    object_call(cfg, s_give_x, event_new(a_keep, n_42));
+    result = object_call(cfg, s_dispatch_x, n_2);
+    assert(n_1 == result);  // handoff queued when count ran out
+    assert(a_keep == as_event(b_keep->kept)->actor);  // the kept event is as it was dispatched
+    assert(n_42 == as_event(b_keep->kept)->msg);
+    n_heap = gc_count();
+    result = object_call(cfg, s_dispatch_x, integer_new(100));
+    assert(n_0 == result);
+    assert(gc_count() <= n_heap + 20 + 3);  // an event per hop, effects after a run of handoffs, and the log
+    assert(o_nil != b_rec_h->log);
+    assert(n_42 == as_pair(b_rec_h->log)->h);
+    assert(o_nil == as_pair(b_rec_h->log)->t);
+    
+    TRACE(fprintf(stderr, "---- scope ----\n"));
+    OOP sc_outer = scope_new(o_empty_scope);
+    object_call(sc_outer, s_bind, s_x, n_42);
+    OOP sc_inner = scope_new(sc_outer);
+    for (k = 0; k < 100; ++k) {
+        sprintf(k_name, "k%d", k);
+        object_call(sc_inner, s_bind, symbol_new(k_name), integer_new(k));
+    }
+    object_call(sc_inner, s_bind, s_y, n_1);
+    object_call(sc_inner, s_bind, s_y, n_2);  // rebind in place
+    assert(n_2 == object_call(sc_inner, s_lookup, s_y));
+    assert(n_42 == object_call(sc_inner, s_lookup, s_x));  // delegated
+    assert(n_0 == object_call(sc_inner, s_lookup, symbol_new("k0")));
+    assert(integer_new(99) == object_call(sc_inner, s_lookup, symbol_new("k99")));
+    assert(o_fail == object_call(sc_inner, s_lookup, s_z));
+    assert(o_fail == object_call(sc_outer, s_lookup, s_y));
+    assert(101 == as_scope(sc_inner)->count);
+
+    TRACE(fprintf(stderr, "---- json parser ----\n"));
+    OOP g_json = json_grammar_new();
+    TRACE(fprintf(stderr, "g_json = %p\n", g_json));
+//    OOP s_src = string_stream_new("null");
+    OOP s_src = string_stream_new(" [0, {\"N\":42}, true]\n");
+    TRACE(fprintf(stderr, "s_src = %p\n", s_src));    
+    OOP match = match_new(s_src, o_empty_dict, o_undef);
+    TRACE(fprintf(stderr, "match = %p\n", match));
+    match = object_call(g_json, s_match, match);
+    TRACE(fprintf(stderr, "match' = %p\n", match));
+    assert(match_kind == match->kind);
+    OOP memo = memo_new(256);
+    OOP g_digits = memo_pattern_new(plus_pattern_new(if_pattern_new(charset_p_new("0123456789"))), memo);
+    OOP g_retry = or_pattern_new(
+        and_pattern_new(g_digits, eq_pattern_new(integer_new('a'))),
+        and_pattern_new(g_digits, eq_pattern_new(integer_new('b'))));
+    match = object_call(g_retry, s_match, match_new(string_stream_new("123b"), o_empty_dict, o_undef));
+    assert(match_kind == match->kind);
+    assert(1 == as_memo(memo)->misses);
+    assert(1 == as_memo(memo)->hits);  // digits re-tried at the same position
+    memo_reset(memo);
+    g_json = json_grammar_memo_new(memo);
+    match = match_new(string_stream_new(" [0, {\"N\":42}, true]\n"), o_empty_dict, o_undef);
+    match = object_call(g_json, s_match, match);
+    assert(match_kind == match->kind);
+    assert(as_memo(memo)->misses > 1);
+    assert(128 == as_memo(memo_new(100))->size);  // rounded up to a power of 2
+    OOP g_json_vm = pattern_compile(json_grammar_new());
+    s_src = string_stream_new(" [0, {\"N\":42}, true]\n");
+    match = object_call(g_json, s_match, match_new(s_src, o_empty_dict, o_undef));
+    OOP match_vm = object_call(g_json_vm, s_match, match_new(s_src, o_empty_dict, o_undef));
+    assert(match_kind == match_vm->kind);
+    assert(as_match(match)->in == as_match(match_vm)->in);
+    assert(same_value(as_match(match)->out, as_match(match_vm)->out));
+    match_vm = object_call(g_json_vm, s_match, match_new(string_stream_new("[0, }"), o_empty_dict, o_undef));
+    assert(o_fail == match_vm);
+    memo_reset(memo);
+    assert(0 == as_memo(memo)->misses);
+    assert(0 == as_memo(memo)->hits);
+    s_src = string_stream_new("123b");
+    match_vm = object_call(pattern_compile(g_retry), s_match, match_new(s_src, o_empty_dict, o_undef));
+    assert(match_kind == match_vm->kind);
+    assert(1 == as_memo(memo)->misses);
+    assert(1 == as_memo(memo)->hits);  // the compiled rule uses the memo table too
+    match = object_call(g_retry, s_match, match_new(s_src, o_empty_dict, o_undef));
+    assert(as_match(match)->in == as_match(match_vm)->in);
+    assert(1 == as_memo(memo)->misses);
+    assert(3 == as_memo(memo)->hits);  // both alternatives find it, remembered by the compiled rule
+    memo_reset(memo);
+    s_src = string_stream_new(" [0, {\"N\":42}, true]\n");
+    match_vm = object_call(pattern_compile(json_grammar_memo_new(memo)), s_match, match_new(s_src, o_empty_dict, o_undef));
+    match = object_call(g_json, s_match, match_new(s_src, o_empty_dict, o_undef));
+    assert(match_kind == match_vm->kind);
+    assert(as_match(match)->in == as_match(match_vm)->in);
+    assert(same_value(as_match(match)->out, as_match(match_vm)->out));
+    match_vm = object_call(pattern_compile(json_grammar_memo_new(memo)), s_match,
+        match_new(string_stream_new("[0, }"), o_empty_dict, o_undef));
+    assert(o_fail == match_vm);  // failures are remembered too
+    OOP sc_late = scope_new(o_empty_scope);
+    OOP g_late = pattern_compile(named_pattern_new(s_x, sc_late));  // not bound yet
+    object_call(sc_late, s_bind, s_x, g_digits);
+    match_vm = object_call(g_late, s_match, match_new(string_stream_new("42"), o_empty_dict, o_undef));
+    assert(match_kind == match_vm->kind);
+    assert(o_empty_stream == as_match(match_vm)->in);
+    OOP g_bind = and_pattern_new(
+        bind_pattern_new(s_x, plus_pattern_new(if_pattern_new(charset_p_new("0123456789")))),
+        and_pattern_new(star_pattern_new(eq_pattern_new(integer_new(' '))), opt_pattern_new(g_retry)));
+    s_src = string_stream_new("42  7b");
+    match = object_call(g_bind, s_match, match_new(s_src, o_empty_dict, o_undef));
+    match_vm = object_call(pattern_compile(g_bind), s_match, match_new(s_src, o_empty_dict, o_undef));
+    assert(match_kind == match_vm->kind);
+    assert(as_match(match)->in == as_match(match_vm)->in);
+    assert(same_value(as_match(match)->out, as_match(match_vm)->out));
+    assert(same_value(object_call(as_match(match)->env, s_lookup, s_x),
+                      object_call(as_match(match_vm)->env, s_lookup, s_x)));
+    OOP p_ws = charset_p_new(" \t\r\n");
+    s_src = string_stream_new(" \t  \n\n      \r\n                                   x");
+    result = object_call(s_src, s_span, p_ws);
+    assert(pair_kind == result->kind);
+    assert(integer_new('x') == as_pair(object_call(as_pair(result)->t, s_pop))->h);
+    OOP s_pos = s_src;
+    while (as_pair(object_call(s_pos, s_pop))->h != integer_new('x')) {
+        s_pos = as_pair(object_call(s_pos, s_pop))->t;
+    }
+    assert(as_pair(result)->t == s_pos);  // same position, by either path
+    assert(o_nil == object_call(as_pair(result)->t, s_span, p_ws));  // no run
+    s_src = string_stream_new("  x");
+    s_pos = as_pair(object_call(as_pair(object_call(s_src, s_pop))->t, s_pop))->t;  // popped first
+    result = object_call(s_src, s_span, p_ws);
+    assert(s_pos == as_pair(result)->t);  // the same position, found by the first span
+    OOP g_str = star_pattern_new(if_pattern_new(exclset_p_new("\"\\")));
+    s_src = string_stream_new("a string of more than forty characters, to the end");
+    match = object_call(g_str, s_match, match_new(s_src, o_empty_dict, o_undef));
+    assert(o_empty_stream == as_match(match)->in);
+    assert(integer_new('d') == as_match(match)->out);
+    match_vm = object_call(pattern_compile(g_str), s_match, match_new(s_src, o_empty_dict, o_undef));
+    assert(o_empty_stream == as_match(match_vm)->in);
+    assert(integer_new('d') == as_match(match_vm)->out);
+    OOP l_src = pair_new(integer_new('a'), pair_new(integer_new('b'), pair_new(integer_new('"'), o_nil)));  // can't span
+    match = object_call(g_str, s_match, match_new(l_src, o_empty_dict, o_undef));
+    match_vm = object_call(pattern_compile(g_str), s_match, match_new(l_src, o_empty_dict, o_undef));
+    assert(integer_new('b') == as_match(match)->out);
+    assert(as_match(match)->in == as_match(match_vm)->in);
+    assert(integer_new('b') == as_match(match_vm)->out);
+    s_src = string_stream_new("a string that is matched without a stream for each character");
+    size_t n_objs = gc_count();
+    match = object_call(star_pattern_new(ptrn_any), s_match, match_new(s_src, o_empty_dict, o_undef));
+    assert(o_empty_stream == as_match(match)->in);
+    assert(integer_new('r') == as_match(match)->out);
+    assert(gc_count() <= n_objs + 3);  // only the pattern, and the matches
+    match = object_call(and_pattern_new(eq_pattern_new(integer_new('a')), ptrn_any), s_match,
+        match_new(s_src, o_empty_dict, o_undef));
+    s_pos = as_pair(object_call(as_pair(object_call(s_src, s_pop))->t, s_pop))->t;
+    assert(s_pos == as_match(match)->in);  // the same position as popping
+
+    TRACE(fprintf(stderr, "---- pool allocation ----\n"));
+    struct alloc_stats stats;
+    alloc_stats(&stats);
+    size_t n_allocs = stats.allocs;
+    size_t n_frees = stats.frees;
+    void * p_mem = ALLOC(24);
+    void * p_old = p_mem;
+    FREE(p_mem);
+    assert(NULL == p_mem);
+    p_mem = ALLOC(17);  // same size class
+    if (art_allocator == &pool_allocator) {
+        assert(p_old == p_mem);  // block recycled
+    }
+    FREE(p_mem);
+    alloc_stats(&stats);
+    TRACE(fprintf(stderr, "allocs=%lu frees=%lu bytes=%lu\n",
+        (unsigned long)stats.allocs, (unsigned long)stats.frees, (unsigned long)stats.bytes));
+    assert(stats.allocs == n_allocs + 2);
+    assert(stats.frees == n_frees + 2);
+
+    TRACE(fprintf(stderr, "---- arena allocation ----\n"));
+    struct arena * arena = arena_new();
+    struct arena_mark mark = arena_mark(arena);
+    struct arena * prev = arena_use(arena);
+    OOP p_tmp = pair_new(o_nil, o_nil);
+    arena_use(prev);
+    TRACE(fprintf(stderr, "p_tmp = %p\n", p_tmp));
+    assert(arena_used(arena) >= sizeof(struct pair));
+    arena_rewind(arena, mark);
+    assert(arena_used(arena) == 0);
+    cfg = config_new();
+    as_config(cfg)->arena = arena;
+    OOP a_fwd_1 = actor_new(forward_beh_new(a_sink));
+    OOP a_fwd_2 = actor_new(forward_beh_new(a_fwd_1));
+    object_call(cfg, s_give_x, event_new(a_fwd_2, n_42));
+    object_call(cfg, s_give_x, event_new(a_fwd_2, n_0));  // queued, so no handoff
+    result = object_call(cfg, s_dispatch_x, integer_new(10));
+    assert(o_true == object_call(result, s_eq_p, n_0));
+    assert(arena_used(arena) > 0);  // events sent by forwarding actors
+    arena_reset(arena);
+    assert(arena_used(arena) == 0);
+    OOP sc_arena = scope_new(o_empty_scope);
+    char name[8];
+    for (k = 0; k < 12; ++k) {  // one more would grow the table
+        snprintf(name, sizeof(name), "a%d", k);
+        object_call(sc_arena, s_bind, symbol_new(name), integer_new(k));
+    }
+    struct bind_beh * b_bind = object_alloc(struct bind_beh, bind_beh_kind);
+    b_bind->scope = sc_arena;
+    object_call(cfg, s_give_x, event_new(actor_new((OOP)b_bind), symbol_new("grown")));
+    result = object_call(cfg, s_dispatch_x, n_1);
+    assert(n_0 == result);  // aborted, with the grown table in the arena
+    assert(arena_used(arena) == 0);
+    prev = arena_use(arena);
+    for (k = 0; k < 100; ++k) {
+        pair_new(o_true, o_true);  // reuse the rewound memory
+    }
+    arena_use(prev);
+    assert(16 == as_scope(sc_arena)->size);  // the store was undone
+    assert(12 == as_scope(sc_arena)->count);
+    for (k = 0; k < 12; ++k) {
+        snprintf(name, sizeof(name), "a%d", k);
+        assert(integer_new(k) == object_call(sc_arena, s_lookup, symbol_new(name)));
+    }
+    assert(o_fail == object_call(sc_arena, s_lookup, symbol_new("grown")));
+    OOP memo_arena = memo_new(16);
+    struct parse_beh * b_parse = object_alloc(struct parse_beh, parse_beh_kind);
+    b_parse->ptrn = memo_pattern_new(plus_pattern_new(if_pattern_new(charset_p_new("0123456789"))), memo_arena);
+    OOP a_parse = actor_new((OOP)b_parse);
+    object_call(cfg, s_give_x, event_new(a_parse, o_nil));
+    result = object_call(cfg, s_dispatch_x, n_1);
+    assert(n_0 == result);  // aborted, with its stream in the arena
+    assert(1 == as_memo(memo_arena)->misses);
+    object_call(cfg, s_give_x, event_new(a_parse, o_nil));
+    result = object_call(cfg, s_dispatch_x, n_1);  // a new stream, at the same (rewound) address
+    assert(n_0 == result);
+    assert(2 == as_memo(memo_arena)->misses);  // the first result was forgotten
+    assert(0 == as_memo(memo_arena)->hits);
+    arena_reset(arena);
+
+    TRACE(fprintf(stderr, "---- garbage collection ----\n"));
+    OOP d_live = object_call(o_empty_dict, s_bind, s_x, n_42);
+    gc_root(&d_live);
+    size_t n_live = gc_count();
+    int i;
+    for (i = 0; i < 100; ++i) {
+        pair_new(o_nil, o_nil);  // garbage
+    }
+    assert(gc_count() == n_live + 100);
+    size_t n_freed = gc_collect();
+    TRACE(fprintf(stderr, "n_freed = %lu\n", (unsigned long)n_freed));
+    assert(n_freed >= 100);
+    assert(gc_count() < n_live);
+    result = object_call(d_live, s_lookup, s_x);
+    assert(n_42 == result);
+    struct gc_txn txn;
+    struct gc_txn txn_inner;
+    n_live = gc_count();
+    gc_begin(&txn);
+    gc_begin(&txn_inner);
+    pair_new(o_nil, o_nil);
+    gc_commit(&txn_inner);  // joins the enclosing transaction
+    assert(gc_count() == n_live);
+    assert(1 == gc_abort(&txn));
+    OOP o_scope = scope_new(o_empty_scope);
+    object_call(o_scope, s_bind, s_x, n_42);
+    OOP s_txt = string_stream_new("ab");
+    gc_begin(&txn);
+    for (i = 0; i < 20; ++i) {  // grows the table
+        object_call(o_scope, s_bind, symbol_new_n("abcdefghijklmnopqrst", i + 1), pair_new(n_0, n_1));
+    }
+    object_call(s_txt, s_pop);  // caches the next position
+    gc_abort(&txn);
+    assert(n_42 == object_call(o_scope, s_lookup, s_x));  // stores rolled back
+    assert(o_fail == object_call(o_scope, s_lookup, symbol_new("a")));
+    result = object_call(s_txt, s_pop);
+    assert(integer_new('a') == as_pair(result)->h);
+    assert(integer_new('b') == as_pair(object_call(as_pair(result)->t, s_pop))->h);
+
+    TRACE(fprintf(stderr, "---- inline caches ----\n"));
+    icache_reset();
+    for (i = 0; i < 10; ++i) {
+        result = object_call(d_live, s_lookup, s_x);
+        assert(n_42 == result);
+    }
+    size_t n_hits = 0;
+    size_t n_misses = 0;
+    struct icache * ic;
+    for (ic = icache_list; ic != NULL; ic = ic->next) {
+        TRACE(fprintf(stderr, "icache %s: hits=%lu misses=%lu\n",
+            ic->site, (unsigned long)ic->hits, (unsigned long)ic->misses));
+        n_hits += ic->hits;
+        n_misses += ic->misses;
+    }
+    assert(n_hits >= 9);  // the first lookup may fill the cache
+    assert(n_misses <= 1);
+    static struct icache ic_any = ICACHE_INIT("test any selector");
+    OOP argv_lookup[] = { s_lookup, s_x };
+    OOP argv_other[] = { n_42 };  // not a symbol
+    for (i = 0; i < 2; ++i) {  // miss, then hit
+        assert(n_42 == icache_send(&ic_any, d_live, argv_lookup));
+        assert(o_undef == icache_send(&ic_any, d_live, argv_other));
+    }
+    assert(ic_any.hits >= 2);
+    gc_unroot(&d_live);
+
+    TRACE(fprintf(stderr, "---- parallel configuration ----\n"));
+    OOP pcfg = pconfig_new(4);
+    for (i = 0; i < 10; ++i) {
+        object_call(pcfg, s_give_x, event_new(a_sink, integer_new(i)));
+    }
+    result = object_call(pcfg, s_dispatch_x, integer_new(4));
+    assert(integer_new(6) == result);
+    struct count_beh * b_count = object_alloc(struct count_beh, count_beh_kind);
+    OOP a_count = actor_new((OOP)b_count);
+    OOP a_fwd_p = actor_new(forward_beh_new(a_count));
+    for (i = 0; i < 500; ++i) {
+        object_call(pcfg, s_give_x, event_new(a_count, integer_new(i)));
+        object_call(pcfg, s_give_x, event_new(a_fwd_p, integer_new(i)));
+    }
+    result = object_call(pcfg, s_dispatch_x, integer_new(1000000));
+    assert(n_0 == result);
+    TRACE(fprintf(stderr, "b_count->n = %d\n", b_count->n));
+    assert(1000 == b_count->n);
+    assert(NULL == as_actor(a_count)->inbox);
+    assert(NULL == as_actor(a_count)->mailbox);
+    b_count->n = 0;
+    OOP l_msgs = o_nil;
+    for (i = 0; i < 100; ++i) {
+        l_msgs = pair_new(integer_new(i), l_msgs);
+    }
+    struct burst_beh * b_burst_p = object_alloc(struct burst_beh, burst_beh_kind);
+    b_burst_p->target = a_count;
+    b_burst_p->msgs = l_msgs;  // 100 messages
+    sponsor = sponsor_new(15, 100000, 10000000);
+    event = event_new(actor_new((OOP)b_burst_p), n_0);
+    as_event(event)->sponsor = sponsor;
+    object_call(pcfg, s_give_x, event);
+    result = object_call(pcfg, s_dispatch_x, integer_new(1000));
+    assert(n_0 == result);  // held
+    assert(0 == b_count->n);
+    assert(as_sponsor(sponsor)->suspended);
+    assert(15 == as_sponsor(sponsor)->messages);  // refunded
+    result = sponsor_refill(sponsor, pcfg, 100, 0, 0);
+    assert(n_1 == result);
+    result = object_call(pcfg, s_dispatch_x, integer_new(1000));
+    assert(n_0 == result);
+    assert(100 == b_count->n);
+    assert(15 == as_sponsor(sponsor)->messages);
+    as_pconfig(pcfg)->deterministic = 1;
+    OOP l_log_1 = burst_test(pcfg);
+    OOP l_log_2 = burst_test(pcfg);
+    while (o_nil != l_log_1) {  // same schedule every time
+        assert(as_pair(l_log_1)->h == as_pair(l_log_2)->h);
+        l_log_1 = as_pair(l_log_1)->t;
+        l_log_2 = as_pair(l_log_2)->t;
+    }
+    assert(o_nil == l_log_2);
+    pconfig_stop(pcfg);
+    pcfg = pconfig_new(1);
+    as_pconfig(pcfg)->quota = 1;
+    struct forward_beh * b_loop = as_forward_beh(forward_beh_new(a_sink));
+    OOP a_loop = actor_new((OOP)b_loop);
+    b_loop->target = a_loop;  // keeps sending to itself
+    struct record_beh * b_rec = object_alloc(struct record_beh, record_beh_kind);
+    b_rec->log = o_nil;
+    OOP a_rec = actor_new((OOP)b_rec);
+    object_call(pcfg, s_give_x, event_new(a_loop, n_0));
+    result = object_call(pcfg, s_dispatch_x, n_5);  // get the loop going
+    assert(n_1 == result);
+    for (i = 0; i < 5; ++i) {
+        object_call(pcfg, s_give_x, event_new(a_rec, integer_new(i)));
+    }
+    result = object_call(pcfg, s_dispatch_x, integer_new(10));
+    assert(n_1 == result);  // only the loop remains
+    for (i = 4; i >= 0; --i) {  // no starvation
+        assert(integer_new(i) == as_pair(b_rec->log)->h);
+        b_rec->log = as_pair(b_rec->log)->t;
+    }
+    pconfig_stop(pcfg);
+
+    TRACE(fprintf(stderr, "---- sharded configuration ----\n"));
+    OOP shards = shards_new(2);
+    b_rec = object_alloc(struct record_beh, record_beh_kind);
+    b_rec->log = o_nil;
+    a_rec = actor_new((OOP)b_rec);
+    as_actor(a_rec)->config = shards_config(shards, 1);
+    struct burst_beh * b_burst = object_alloc(struct burst_beh, burst_beh_kind);
+    b_burst->target = a_rec;
+    b_burst->msgs = o_nil;
+    for (i = 299; i >= 0; --i) {  // more than fit in a queue between shards
+        b_burst->msgs = pair_new(integer_new(i), b_burst->msgs);
+    }
+    OOP a_burst = actor_new((OOP)b_burst);
+    as_actor(a_burst)->config = shards_config(shards, 0);
+    object_call(shards, s_give_x, event_new(a_burst, o_nil));
+    result = object_call(shards, s_dispatch_x, integer_new(1000));
+    assert(n_0 == result);
+    for (i = 299; i >= 0; --i) {  // in the order sent
+        assert(integer_new(i) == as_pair(b_rec->log)->h);
+        b_rec->log = as_pair(b_rec->log)->t;
+    }
+    assert(o_nil == b_rec->log);
+    a_chain = a_rec;
+    for (i = 0; i < 10; ++i) {  // alternate between shards
+        a_chain = actor_new(forward_beh_new(a_chain));
+        as_actor(a_chain)->config = shards_config(shards, i & 1);
+    }
+    object_call(shards, s_give_x, event_new(a_chain, n_42));
+    result = object_call(shards, s_dispatch_x, n_5);
+    assert(n_0 != result);  // stopped part way
+    result = object_call(shards, s_dispatch_x, integer_new(100));
+    assert(n_0 == result);
+    assert(n_42 == as_pair(b_rec->log)->h);
+    struct count_beh * b_count_s = object_alloc(struct count_beh, count_beh_kind);
+    b_count_s->n = 0;
+    OOP a_count_s = actor_new((OOP)b_count_s);  // no owner
+    for (i = 0; i < 2; ++i) {  // send from both shards
+        struct burst_beh * b_burst_u = object_alloc(struct burst_beh, burst_beh_kind);
+        b_burst_u->target = a_count_s;
+        b_burst_u->msgs = b_burst->msgs;
+        OOP a_burst_u = actor_new((OOP)b_burst_u);
+        as_actor(a_burst_u)->config = shards_config(shards, i);
+        object_call(shards, s_give_x, event_new(a_burst_u, o_nil));
+    }
+    result = object_call(shards, s_dispatch_x, integer_new(1000));
+    assert(n_0 == result);
+    assert(600 == b_count_s->n);  // one message at a time
+    b_count_s->n = 0;
+    as_actor(a_count_s)->config = config_new();  // owned outside the group
+    for (i = 0; i < 2; ++i) {
+        struct burst_beh * b_burst_p = object_alloc(struct burst_beh, burst_beh_kind);
+        b_burst_p->target = a_count_s;
+        b_burst_p->msgs = b_burst->msgs;
+        OOP a_burst_p = actor_new((OOP)b_burst_p);
+        as_actor(a_burst_p)->config = shards_config(shards, i);
+        object_call(shards, s_give_x, event_new(a_burst_p, o_nil));
+    }
+    result = object_call(shards, s_dispatch_x, integer_new(1000));
+    assert(n_0 == result);
+    assert(600 == b_count_s->n);  // on the first shard
+    b_count_s->n = 0;
+    as_actor(a_count_s)->config = shards_config(shards, 1);
+    struct burst_beh * b_burst_h = object_alloc(struct burst_beh, burst_beh_kind);
+    b_burst_h->target = a_count_s;
+    b_burst_h->msgs = l_msgs;  // 100 messages
+    OOP a_burst_h = actor_new((OOP)b_burst_h);
+    as_actor(a_burst_h)->config = shards_config(shards, 0);
+    sponsor = sponsor_new(15, 100000, 10000000);
+    event = event_new(a_burst_h, n_0);
+    as_event(event)->sponsor = sponsor;
+    object_call(shards, s_give_x, event);
+    result = object_call(shards, s_dispatch_x, integer_new(1000));
+    assert(n_0 == result);  // held
+    assert(0 == b_count_s->n);
+    assert(as_sponsor(sponsor)->suspended);
+    result = sponsor_refill(sponsor, shards, 100, 0, 0);
+    assert(n_1 == result);
+    result = object_call(shards, s_dispatch_x, integer_new(1000));
+    assert(n_0 == result);
+    assert(100 == b_count_s->n);  // on the other shard
+    assert(15 == as_sponsor(sponsor)->messages);
+    gc_unroot(&sponsor);
+    shards_stop(shards);
+
+    TRACE(fprintf(stderr, "---- remote actors ----\n"));
+    int sv[2];
+    k = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(0 == k);
+    OOP link = link_new(sv[0]);
+    OOP cfg_r = config_new();
+    OOP rcvr = receiver_new(sv[1], cfg_r);
+    b_rec = object_alloc(struct record_beh, record_beh_kind);
+    b_rec->log = o_nil;
+    a_rec = actor_new((OOP)b_rec);
+    assert(0 == receiver_export(rcvr, a_sink));
+    assert(1 == receiver_export(rcvr, a_rec));
+    OOP a_proxy = actor_new(proxy_beh_new(link, 1));
+    b_burst->target = a_proxy;  // 300 integers
+    cfg = config_new();
+    object_call(cfg, s_give_x, event_new(a_burst, o_nil));
+    OOP l_msg = pair_new(symbol_new("remote"), pair_new(o_true, pair_new(integer_new(-7), pair_new(s_give_x, o_nil))));
+    object_call(cfg, s_give_x, event_new(a_proxy, l_msg));
+    object_call(cfg, s_give_x, event_new(a_proxy, a_rec));  // actors can't be sent
+    result = object_call(cfg, s_dispatch_x, integer_new(1000));
+    assert(n_0 == result);
+    assert(0 == link_flush(link));
+    assert(301 == receiver_poll(rcvr));
+    result = object_call(cfg_r, s_dispatch_x, integer_new(1000));
+    assert(n_0 == result);
+    for (i = 299; i >= 0; --i) {  // in the order sent
+        assert(integer_new(i) == as_pair(b_rec->log)->h);
+        b_rec->log = as_pair(b_rec->log)->t;
+    }
+    result = as_pair(b_rec->log)->h;  // the list, first
+    assert(symbol_new("remote") == as_pair(result)->h);
+    assert(o_true == as_pair(as_pair(result)->t)->h);
+    assert(integer_new(-7) == as_pair(as_pair(as_pair(result)->t)->t)->h);
+    result = as_pair(as_pair(as_pair(result)->t)->t)->t;
+    assert(s_give_x == as_pair(result)->h);  // still a selector
+    assert(SEL_GIVE_X == selector_of(as_pair(result)->h));
+    assert(o_nil == as_pair(result)->t);
+    assert(o_nil == as_pair(b_rec->log)->t);
+    assert(0 == receiver_poll(rcvr));  // nothing more
+    sponsor = sponsor_new(15, 0, 100000);  // no allocations
+    gc_root(&sponsor);
+    event = event_new(a_proxy, n_1);
+    as_event(event)->sponsor = sponsor;
+    object_call(cfg, s_give_x, event);
+    result = object_call(cfg, s_dispatch_x, n_5);
+    assert(n_0 == result);  // aborted, and held
+    assert(sizeof(uint32_t) == as_link(link)->used);  // nothing written
+    result = sponsor_refill(sponsor, cfg, 0, 1000, 0);
+    assert(n_1 == result);
+    result = object_call(cfg, s_dispatch_x, n_5);
+    assert(n_0 == result);
+    assert(sizeof(uint32_t) < as_link(link)->used);  // written once committed
+    gc_unroot(&sponsor);
+    assert(0 == link_flush(link));
+    assert(1 == receiver_poll(rcvr));  // exactly once
+    b_rec->log = o_nil;
+    result = object_call(cfg_r, s_dispatch_x, n_5);
+    assert(n_0 == result);
+    assert(n_1 == as_pair(b_rec->log)->h);
+    receiver_close(rcvr);
+    object_call(cfg, s_give_x, event_new(a_proxy, n_2));
+    result = object_call(cfg, s_dispatch_x, n_5);
+    assert(n_0 == result);
+    assert(-1 == link_flush(link));  // the other end is closed
+    object_call(cfg, s_give_x, event_new(a_proxy, n_2));
+    result = object_call(cfg, s_dispatch_x, n_5);
+    assert(n_0 == result);  // aborted
+    assert(sizeof(uint32_t) == as_link(link)->used);
+    assert(-1 == link_close(link));
+}
+
+/*
+    Main entry-point
+*/
+int
+main()
+{
+    run_tests();
+    return 0;
+}
@@ -0,0 +1,416 @@
+/*
+
+gc.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stdio.h>  /* for TRACE */
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "gc.h"
+#include "arena.h"
+
+/*
+gc:
+    Objects allocated by 'object_new' are managed by a mark-sweep collector.
+
+    Each heap object is preceded by a header linking it into the chain of all heap objects.
+    A hash-set of heap object addresses lets the marker recognize references among the fields
+    of a reachable object, so other words (integers, C strings, static objects) are skipped.
+
+    Roots are variables registered with 'gc_root', objects registered with 'gc_retain',
+    and the contents of every arena.  Static objects live outside the heap and are never collected.
+
+    Allocation and root registration may be called from any thread, serialized by 'gc_lock'.
+
+    A thread may allocate within a transaction, started by 'gc_begin'.
+    Objects allocated in a transaction are held on a private chain, without taking 'gc_lock'.
+    'gc_commit' adds them all to the heap at once (or to the enclosing transaction, if there is one).
+    'gc_abort' frees them immediately, so nothing outside the transaction may still refer to them.
+    An object that existed before the transaction must be updated with 'gc_store' (or 'gc_log'),
+    which remembers the old value of the field, so 'gc_abort' can restore it before freeing anything.
+
+    NOTE: Collection only happens when 'gc_collect' is called.
+          The caller must ensure that every live object is reachable from a root at that point,
+          and that no other thread is using the heap (e.g.: no parallel configuration is dispatching).
+*/
+
+struct gc_header {
+    struct gc_header *  next;       // chain of all heap objects
+    size_t              size;       // object size (in bytes)
+    size_t              mark;       // reached during current collection?
+};
+#define gc_header_of(oop) (((struct gc_header *)(oop)) - 1)
+#define gc_object_of(hp) ((OOP)(((struct gc_header *)(hp)) + 1))
+
+static pthread_mutex_t gc_lock = PTHREAD_MUTEX_INITIALIZER;  // guards all collector state
+static _Thread_local struct gc_txn * gc_txn_current = NULL;  // transaction of this thread (or NULL)
+static struct gc_header * gc_heap = NULL;  // chain of all heap objects
+static size_t gc_heap_count = 0;  // number of heap objects
+
+static OOP * gc_set = NULL;  // open-addressing set of heap object addresses
+static size_t gc_set_size = 0;  // capacity of 'gc_set' (power of 2)
+
+static OOP ** gc_roots = NULL;  // addresses of root variables
+static size_t gc_roots_count = 0;
+static size_t gc_roots_limit = 0;
+
+static OOP * gc_retained = NULL;  // root objects
+static size_t gc_retained_count = 0;
+static size_t gc_retained_limit = 0;
+
+static OOP * gc_stack = NULL;  // objects marked, but not yet scanned
+static size_t gc_stack_count = 0;
+static size_t gc_stack_limit = 0;
+
+static void *
+gc_grow(void * items, size_t count, size_t * limit, size_t size)
+{
+    if (count < *limit) {
+        return items;
+    }
+    size_t n = (*limit < 16) ? 16 : (*limit << 1);
+    void * p = ALLOC(n * size);
+    if (items != NULL) {
+        memcpy(p, items, count * size);
+        FREE(items);
+    }
+    *limit = n;
+    return p;
+}
+
+static size_t
+gc_hash(OOP oop)
+{
+    uintptr_t h = ((uintptr_t)oop) >> 3;  // low bits are always zero
+    h *= (uintptr_t)0x9E3779B97F4A7C15ULL;  // Fibonacci hashing
+    return (size_t)(h ^ (h >> 16));
+}
+
+static void
+gc_set_insert(OOP oop)
+{
+    size_t mask = gc_set_size - 1;
+    size_t i = gc_hash(oop) & mask;
+    while (gc_set[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    gc_set[i] = oop;
+}
+
+static void
+gc_set_rebuild()
+{
+    size_t n = 64;
+    while (n < (gc_heap_count << 1)) {  // keep load factor below 1/2
+        n <<= 1;
+    }
+    if (gc_set != NULL) {
+        FREE(gc_set);
+    }
+    gc_set = (OOP *)ALLOC(n * sizeof(OOP));
+    gc_set_size = n;
+    struct gc_header * hp;
+    for (hp = gc_heap; hp != NULL; hp = hp->next) {
+        gc_set_insert(gc_object_of(hp));
+    }
+}
+
+static int
+gc_set_member(OOP oop)
+{
+    if (gc_set_size == 0) {
+        return 0;
+    }
+    size_t mask = gc_set_size - 1;
+    size_t i = gc_hash(oop) & mask;
+    while (gc_set[i] != NULL) {
+        if (gc_set[i] == oop) {
+            return 1;
+        }
+        i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+void *
+gc_alloc(size_t size)
+{
+    struct gc_header * hp = (struct gc_header *)ALLOC(sizeof(struct gc_header) + size);
+    hp->size = size;
+    struct gc_txn * txn = gc_txn_current;
+    if (txn != NULL) {  // hold until commit/abort
+        hp->next = txn->head;
+        txn->head = hp;
+        if (txn->tail == NULL) {
+            txn->tail = hp;
+        }
+        ++txn->count;
+        txn->bytes += size;
+        return gc_object_of(hp);
+    }
+    pthread_mutex_lock(&gc_lock);
+    hp->next = gc_heap;
+    gc_heap = hp;
+    ++gc_heap_count;
+    if ((gc_heap_count << 1) > gc_set_size) {
+        gc_set_rebuild();
+    } else {
+        gc_set_insert(gc_object_of(hp));
+    }
+    pthread_mutex_unlock(&gc_lock);
+    return gc_object_of(hp);
+}
+
+/*
+    Start a transaction, holding objects allocated by this thread on a private chain.
+*/
+void
+gc_begin(struct gc_txn * txn)
+{
+    txn->prev = gc_txn_current;
+    txn->head = NULL;
+    txn->tail = NULL;
+    txn->count = 0;
+    txn->bytes = 0;
+    txn->undo = NULL;
+    txn->undo_count = 0;
+    txn->undo_limit = 0;
+    gc_txn_current = txn;
+}
+
+/*
+    Remember the word at 'field', so it is restored if the current transaction (if any) aborts.
+*/
+void
+gc_log(void * field)
+{
+    struct gc_txn * txn = gc_txn_current;
+    if (txn != NULL) {
+        txn->undo = gc_grow(txn->undo, txn->undo_count, &txn->undo_limit, sizeof(struct gc_undo));
+        txn->undo[txn->undo_count].field = (OOP *)field;
+        txn->undo[txn->undo_count].old = *(OOP *)field;
+        ++txn->undo_count;
+    }
+}
+
+/*
+    Store 'value' in 'field', an existing object that may refer to objects allocated in the current transaction.
+*/
+void
+gc_store(OOP * field, OOP value)
+{
+    gc_log(field);
+    *field = value;
+}
+
+/*
+    End a transaction, adding the objects allocated in it to the heap (or to the enclosing transaction).
+*/
+void
+gc_commit(struct gc_txn * txn)
+{
+    struct gc_txn * prev = txn->prev;
+    gc_txn_current = prev;
+    if (prev != NULL) {  // the enclosing transaction may still abort
+        size_t i;
+        for (i = 0; i < txn->undo_count; ++i) {
+            prev->undo = gc_grow(prev->undo, prev->undo_count, &prev->undo_limit, sizeof(struct gc_undo));
+            prev->undo[prev->undo_count++] = txn->undo[i];
+        }
+    }
+    if (txn->undo != NULL) {
+        FREE(txn->undo);
+    }
+    if (txn->count == 0) {
+        return;
+    }
+    if (prev != NULL) {
+        txn->tail->next = prev->head;
+        prev->head = txn->head;
+        if (prev->tail == NULL) {
+            prev->tail = txn->tail;
+        }
+        prev->count += txn->count;
+        prev->bytes += txn->bytes;
+        return;
+    }
+    pthread_mutex_lock(&gc_lock);
+    txn->tail->next = gc_heap;
+    gc_heap = txn->head;
+    gc_heap_count += txn->count;
+    if ((gc_heap_count << 1) > gc_set_size) {
+        gc_set_rebuild();
+    } else {
+        struct gc_header * hp;
+        for (hp = txn->head; hp != txn->tail->next; hp = hp->next) {
+            gc_set_insert(gc_object_of(hp));
+        }
+    }
+    pthread_mutex_unlock(&gc_lock);
+}
+
+/*
+    End a transaction, restoring the fields stored in it, freeing the objects allocated in it,
+    and returning how many were freed.
+*/
+size_t
+gc_abort(struct gc_txn * txn)
+{
+    gc_txn_current = txn->prev;
+    while (txn->undo_count > 0) {  // newest first
+        struct gc_undo * up = &txn->undo[--txn->undo_count];
+        *up->field = up->old;
+    }
+    if (txn->undo != NULL) {
+        FREE(txn->undo);
+    }
+    struct gc_header * hp = txn->head;
+    while (hp != NULL) {
+        struct gc_header * next = hp->next;
+        FREE(hp);
+        hp = next;
+    }
+    return txn->count;
+}
+
+void
+gc_root(OOP * ref)
+{
+    pthread_mutex_lock(&gc_lock);
+    gc_roots = gc_grow(gc_roots, gc_roots_count, &gc_roots_limit, sizeof(OOP *));
+    gc_roots[gc_roots_count++] = ref;
+    pthread_mutex_unlock(&gc_lock);
+}
+
+void
+gc_unroot(OOP * ref)
+{
+    size_t i;
+    pthread_mutex_lock(&gc_lock);
+    for (i = 0; i < gc_roots_count; ++i) {
+        if (gc_roots[i] == ref) {
+            gc_roots[i] = gc_roots[--gc_roots_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gc_lock);
+}
+
+void
+gc_retain(OOP obj)
+{
+    pthread_mutex_lock(&gc_lock);
+    gc_retained = gc_grow(gc_retained, gc_retained_count, &gc_retained_limit, sizeof(OOP));
+    gc_retained[gc_retained_count++] = obj;
+    pthread_mutex_unlock(&gc_lock);
+}
+
+void
+gc_release(OOP obj)
+{
+    size_t i;
+    pthread_mutex_lock(&gc_lock);
+    for (i = 0; i < gc_retained_count; ++i) {
+        if (gc_retained[i] == obj) {
+            gc_retained[i] = gc_retained[--gc_retained_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&gc_lock);
+}
+
+static void
+gc_mark(OOP oop)
+{
+    if (gc_set_member(oop)) {
+        struct gc_header * hp = gc_header_of(oop);
+        if (!hp->mark) {
+            hp->mark = 1;
+            gc_stack = gc_grow(gc_stack, gc_stack_count, &gc_stack_limit, sizeof(OOP));
+            gc_stack[gc_stack_count++] = oop;
+        }
+    }
+}
+
+static void
+gc_scan()
+{
+    while (gc_stack_count > 0) {
+        OOP oop = gc_stack[--gc_stack_count];
+        OOP * field = (OOP *)oop;
+        size_t n = gc_header_of(oop)->size / sizeof(OOP);
+        size_t i;
+        for (i = 1; i < n; ++i) {  // field[0] is 'kind'
+            gc_mark(field[i]);
+        }
+    }
+}
+
+/*
+    Reclaim all heap objects unreachable from the roots, returning the number reclaimed.
+*/
+size_t
+gc_collect()
+{
+    size_t i;
+    pthread_mutex_lock(&gc_lock);
+    for (i = 0; i < gc_roots_count; ++i) {
+        gc_mark(*gc_roots[i]);
+    }
+    for (i = 0; i < gc_retained_count; ++i) {
+        gc_mark(gc_retained[i]);
+    }
+    arena_scan(gc_mark);
+    gc_scan();
+    size_t freed = 0;
+    struct gc_header ** link = &gc_heap;
+    while (*link != NULL) {
+        struct gc_header * hp = *link;
+        if (hp->mark) {
+            hp->mark = 0;
+            link = &hp->next;
+        } else {
+            *link = hp->next;
+            FREE(hp);
+            ++freed;
+        }
+    }
+    gc_heap_count -= freed;
+    gc_set_rebuild();
+    pthread_mutex_unlock(&gc_lock);
+    TRACE(fprintf(stderr, "gc_collect: live=%lu freed=%lu\n", (unsigned long)gc_heap_count, (unsigned long)freed));
+    return freed;
+}
+
+/*
+    Return the number of objects currently allocated in the heap.
+*/
+size_t
+gc_count()
+{
+    return gc_heap_count;
+}
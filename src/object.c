@@ -1,105 +1,279 @@
-/*
-
-object.c -- Actor Run-Time
-
-"MIT License"
-
-Copyright (c) 2013 Dale Schumacher, Tristan Slominski
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in
-all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-THE SOFTWARE.
-
-*/
-
-//#include <stdio.h>  /* for TRACE */
-#include "object.h"
-
-/*
-object:
-    Object is the root kind, containing just a polymorphic dispatch procedure.
-*/
-
-OOP
-object_call(OOP obj, ...)
-{
-    va_list args;
-
-    va_start(args, obj);
-    OOP result = (obj->kind)(obj, args);
-    va_end(args);
-    return result;
-}
-
-OOP
-object_new(DISP kind, size_t size)
-{
-    OOP self = (OOP)ALLOC(size);
-    self->kind = kind;
-    return self;
-}
-
-static KIND(undef_kind)
-{
-    return o_undef;
-}
-
-struct object undef_object = { undef_kind };
-
-KIND(object_kind)
-{
-    OOP cmd = take_arg();
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    }
-    return o_undef;
-}
-
-/*
-symbol:
-    Symbols are constants with a string representation 's'.
-*/
-
-OOP
-symbol_new(char * name)
-{
-    struct symbol * this = object_alloc(struct symbol, symbol_kind);
-    this->s = name;
-    return (OOP)this;
-}
-
-KIND(symbol_kind)
-{
-    OOP cmd = take_arg();
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    }
-    return o_undef;
-}
-
-struct symbol _t_symbol = { { symbol_kind }, "#t" };
-struct symbol _f_symbol = { { symbol_kind }, "#f" };
-
-struct symbol eq_p_symbol = { { symbol_kind }, "eq?" };
+/*
+
+object.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+//#include <stdio.h>  /* for TRACE */
+#include <string.h>
+#include <pthread.h>
+#include "object.h"
+#include "gc.h"
+#include "arena.h"
+
+/*
+object:
+    Object is the root kind, containing just a polymorphic dispatch procedure.
+
+    Objects are allocated from the garbage-collected heap (see "gc.c"),
+    or from the current arena, if one is selected (see "arena.c").
+*/
+
+OOP
+object_new(DISP kind, size_t size)
+{
+    OOP self = (OOP)((arena_current != NULL)
+        ? arena_alloc(arena_current, size)
+        : gc_alloc(size));
+    self->kind = kind;
+    return self;
+}
+
+static KIND(undef_kind)
+{
+    return o_undef;
+}
+
+struct object undef_object = { undef_kind };
+
+/*
+    Compare identities (the default 'eq?' method).
+*/
+KIND(object_eq_p)
+{
+    OOP other = take_arg();
+    if (other == self) {  // compare identities
+        return o_true;
+    }
+    return o_false;
+}
+
+KIND(object_kind)
+{
+    OOP cmd = take_arg();
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    }
+    return o_undef;
+}
+
+/*
+symbol:
+    Symbols are constants with a string representation 's'.
+
+    Symbols used as message selectors also carry a small integer selector id 'sel'.
+    Kinds implemented by a method table (see "struct methods") dispatch on this id
+    with a single indexed load, no matter how many selectors they understand.
+    Symbols created by 'symbol_new' are not selectors.
+
+    Symbols created by 'symbol_new' are interned, so equal names yield the same symbol
+    and identity comparison is name comparison.  The intern table is an open-addressed
+    hash table keyed on a precomputed hash of the name.  Interned symbols and copies
+    of their names live in a private arena, outside both the heap and 'arena_current',
+    and are never freed.
+
+    The intern table is shared by all threads, serialized by 'symbol_lock'.
+
+    NOTE: Statically-allocated symbols (such as selectors) are not in the intern table.
+*/
+
+static pthread_mutex_t symbol_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct arena symbol_arena = { NULL, NULL };  // interned symbols and names
+static OOP * symbol_table = NULL;  // open-addressed intern table
+static size_t symbol_table_size = 0;  // always a power of 2
+static size_t symbol_count = 0;
+
+static size_t
+symbol_hash(char * name, size_t n)
+{
+    size_t h = (size_t)2166136261U;  // FNV-1a
+    while (n-- > 0) {
+        h ^= (unsigned char)*name++;
+        h *= (size_t)16777619U;
+    }
+    return h;
+}
+
+static void
+symbol_table_grow()
+{
+    OOP * old_table = symbol_table;
+    size_t old_size = symbol_table_size;
+    size_t size = (old_size > 0) ? (old_size << 1) : 64;
+    size_t mask = size - 1;
+    size_t j;
+    symbol_table = (OOP *)ALLOC(size * sizeof(OOP));
+    memset(symbol_table, 0, size * sizeof(OOP));
+    symbol_table_size = size;
+    for (j = 0; j < old_size; ++j) {
+        OOP sym = old_table[j];
+        if (sym != NULL) {
+            size_t i = as_symbol(sym)->hash & mask;
+            while (symbol_table[i] != NULL) {
+                i = (i + 1) & mask;
+            }
+            symbol_table[i] = sym;
+        }
+    }
+    if (old_table != NULL) {
+        FREE(old_table);
+    }
+}
+
+/*
+    Return the interned symbol for the 'n' characters at 'name' (which need not be NUL-terminated).
+*/
+OOP
+symbol_new_n(char * name, size_t n)
+{
+    pthread_mutex_lock(&symbol_lock);
+    if (4 * (symbol_count + 1) > 3 * symbol_table_size) {  // keep load below 3/4
+        symbol_table_grow();
+    }
+    size_t h = symbol_hash(name, n);
+    size_t mask = symbol_table_size - 1;
+    size_t i = h & mask;
+    OOP sym;
+    while ((sym = symbol_table[i]) != NULL) {
+        struct symbol * this = as_symbol(sym);
+        if ((this->hash == h) && (strncmp(this->s, name, n) == 0) && (this->s[n] == '\0')) {
+            pthread_mutex_unlock(&symbol_lock);
+            return sym;  // already interned
+        }
+        i = (i + 1) & mask;
+    }
+    struct symbol * this = (struct symbol *)arena_alloc(&symbol_arena, sizeof(struct symbol));
+    this->o.kind = symbol_kind;
+    this->s = (char *)arena_alloc(&symbol_arena, n + 1);  // zero-filled, so NUL-terminated
+    memcpy(this->s, name, n);
+    this->hash = h;
+    symbol_table[i] = (OOP)this;
+    ++symbol_count;
+    pthread_mutex_unlock(&symbol_lock);
+    return (OOP)this;
+}
+
+OOP
+symbol_new(char * name)
+{
+    return symbol_new_n(name, strlen(name));
+}
+
+static struct methods symbol_methods = {
+    symbol_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,  // compare identities
+    }
+};
+
+KIND(symbol_kind)
+{
+    return methods_dispatch(&symbol_methods, self, args);
+}
+
+struct symbol _t_symbol = { { symbol_kind }, "#t" };
+struct symbol _f_symbol = { { symbol_kind }, "#f" };
+
+struct symbol eq_p_symbol = { { symbol_kind }, "eq?", SEL_EQ_P };
+
+/*
+methods:
+    Each method table links itself onto 'methods_list' the first time it dispatches,
+    so call sites can map a receiver's kind back to its table.
+    Links are only ever added (with compare-and-swap), so the chain may be searched by any thread.
+*/
+
+static _Atomic(struct methods *) methods_list = NULL;
+
+void
+methods_link(struct methods * mt)
+{
+    if (atomic_exchange(&mt->linked, 1) == 0) {  // only the first caller links 'mt'
+        mt->next = atomic_load(&methods_list);
+        while (!atomic_compare_exchange_weak(&methods_list, &mt->next, mt))
+            ;
+    }
+}
+
+struct methods *
+methods_lookup(DISP kind)
+{
+    struct methods * mt;
+    for (mt = atomic_load(&methods_list); mt != NULL; mt = mt->next) {
+        if (mt->kind == kind) {
+            return mt;
+        }
+    }
+    return NULL;
+}
+
+/*
+icache:
+    Inline caches fill on a miss.  A kind without a method table (or one that
+    has not dispatched yet) is called directly and cached on a later miss.
+    Once all ways are in use, entries are replaced round-robin.
+    Each entry is a single pointer, so threads racing to fill a cache leave it consistent.
+*/
+
+_Atomic(struct icache *) icache_list = NULL;
+
+OOP
+icache_miss(struct icache * ic, OOP obj, OOP * argv)
+{
+    DISP kind = kind_of(obj);
+    icache_count(&ic->misses);
+    if (atomic_exchange(&ic->linked, 1) == 0) {  // only the first caller links 'ic'
+        ic->next = atomic_load(&icache_list);
+        while (!atomic_compare_exchange_weak(&icache_list, &ic->next, ic))
+            ;
+    }
+    struct methods * mt = methods_lookup(kind);
+    if (mt != NULL) {
+        int i;
+        for (i = 0; i < ICACHE_WAYS; ++i) {
+            if (atomic_load_explicit(&ic->entry[i], memory_order_relaxed) == NULL) {
+                break;
+            }
+        }
+        if (i >= ICACHE_WAYS) {
+            i = atomic_fetch_add_explicit(&ic->victim, 1, memory_order_relaxed) % ICACHE_WAYS;
+        }
+        atomic_store_explicit(&ic->entry[i], mt, memory_order_relaxed);
+    }
+    return (*kind)(obj, argv);
+}
+
+void
+icache_reset()
+{
+    struct icache * ic;
+    for (ic = atomic_load(&icache_list); ic != NULL; ic = ic->next) {
+        atomic_store_explicit(&ic->hits, 0, memory_order_relaxed);
+        atomic_store_explicit(&ic->misses, 0, memory_order_relaxed);
+    }
+}
@@ -1,289 +1,461 @@
-/*
-
-pair.c -- Actor Run-Time
-
-"MIT License"
-
-Copyright (c) 2013 Dale Schumacher, Tristan Slominski
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in
-all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-THE SOFTWARE.
-
-*/
-
-#include <stdio.h>  /* for TRACE */
-#include "pair.h"
-
-/*
-pair:
-    A combination of 2 object pointers.  May be treated as a list, terminated by 'o_nil'.
-
-    o' := o.push(x)             -- return a new list with 'x' at the head
-    boolean := o.empty?()       -- return true if list is empty, otherwise false
-    (x, o') := o.pop()          -- remove 'x' from the head, returning it and the new list
-*/
-
-struct symbol empty_p_symbol = { { symbol_kind }, "empty?" };
-struct symbol push_symbol = { { symbol_kind }, "push" };
-struct symbol pop_symbol = { { symbol_kind }, "pop" };
-struct symbol put_symbol = { { symbol_kind }, "put" };
-struct symbol pull_symbol = { { symbol_kind }, "pull" };
-
-static KIND(nil_kind)
-{
-    OOP cmd = take_arg();
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_empty_p) {
-        return o_true;
-    } else if (cmd == s_push) {
-        OOP x = take_arg();
-        return pair_new(x, self);
-    }
-    return o_undef;
-}
-
-struct object nil_object = { nil_kind };
-
-OOP
-pair_new(OOP h, OOP t)
-{
-    struct pair * this = object_alloc(struct pair, pair_kind);
-    this->h = h;
-    this->t = t;
-    return (OOP)this;
-}
-
-KIND(pair_kind)
-{
-//    struct pair * this = as_pair(self);
-    OOP cmd = take_arg();
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_empty_p) {
-        return o_false;
-    } else if (cmd == s_pop) {
-        return self;
-    } else if (cmd == s_push) {
-        OOP x = take_arg();
-        return pair_new(x, self);
-    }
-    return o_undef;
-}
-
-/*
-queue:
-    An efficient mutable (stateful) queue data-structure built from pairs.
-
-    item := o.take!()           -- remove and return 'item' from the head of the queue
-    boolean := o.empty?()       -- return true if queue is empty, otherwise false
-    o := o.give!(item)          -- add 'item' to the tail of the queue
-*/
-
-struct symbol give_x_symbol = { { symbol_kind }, "give!" };
-struct symbol take_x_symbol = { { symbol_kind }, "take!" };
-
-OOP
-queue_new()
-{
-    struct pair * this = object_alloc(struct pair, queue_kind);
-    this->h = o_nil;
-    this->t = o_nil;
-    return (OOP)this;
-}
-
-KIND(queue_kind)
-{
-    struct pair * this = as_pair(self);
-    OOP cmd = take_arg();
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_empty_p) {
-        if (this->h == o_nil) {
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_take_x) {
-        if (this->h != o_nil) {
-            struct pair * entry = as_pair(this->h);
-            this->h = entry->t;
-            OOP item = entry->h;  // entry is garbage after this (use custom free?)
-            return item;
-        }
-    } else if (cmd == s_give_x) {
-        OOP item = take_arg();
-        OOP oop = pair_new(item, o_nil);  // could be a custom allocator
-        if (this->h == o_nil) {
-            this->h = oop;
-        } else {
-            as_pair(this->t)->t = oop;
-        }
-        this->t = oop;
-        return self;
-    }
-    return o_undef;
-}
-
-/*
-dict:
-    Dictionaries define mappings from names to values.
-    
-    In this implementation, each node holds a single 'name'/'value' pair.
-    The 'next' pointer delegates to a linear chain of dictionaries.
-
-    x := o.lookup(name)         -- return value 'x' bound to 'name', or 'o_fail'
-    o' := o.bind(name, x)       -- return new dictionary with 'name' bound to 'x'
-*/
-
-struct symbol bind_symbol = { { symbol_kind }, "bind" };
-struct symbol lookup_symbol = { { symbol_kind }, "lookup" };
-
-struct object fail_object = { object_kind };
-
-static KIND(empty_dict_kind)
-{
-    TRACE(fprintf(stderr, "%p(empty_dict_kind)\n", self));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_lookup) {
-        OOP name = take_arg();
-//        TRACE(fprintf(stderr, "  %p: name=%p\n", self, name));
-        TRACE(fprintf(stderr, "  %p: name=%p \"%s\"\n", self, name, as_symbol(name)->s));
-        return o_fail;
-    } else if (cmd == s_bind) {
-        OOP name = take_arg();
-        OOP value = take_arg();
-//        TRACE(fprintf(stderr, "  %p: name=%p value=%p\n", self, name, value));
-        TRACE(fprintf(stderr, "  %p: name=%p \"%s\" value=%p\n", self, name, as_symbol(name)->s, value));
-        return dict_new(name, value, self);
-    }
-    return o_undef;
-}
-
-struct object empty_dict = { empty_dict_kind };
-
-OOP
-dict_new(OOP name, OOP value, OOP next)
-{
-    struct dict * this = object_alloc(struct dict, dict_kind);
-    this->name = name;
-    this->value = value;
-    this->next = next;
-    return (OOP)this;
-}
-
-KIND(dict_kind)
-{
-//    struct dict * this = as_dict(self);  -- moved inside "do" loop...
-    TRACE(fprintf(stderr, "%p(dict_kind)\n", self));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_lookup) {
-        OOP name = take_arg();
-        TRACE(fprintf(stderr, "  %p: name=%p \"%s\"\n", self, name, as_symbol(name)->s));
-        do {
-            struct dict * this = as_dict(self);  // init/update "this"
-            TRACE(fprintf(stderr, "  %p(dict_kind, %p, %p, %p)\n", this, this->name, this->value, this->next));
-//            if (name == this->name) {  // NOTE: identity comparison on names
-            if (object_call(this->name, s_eq_p, name) == o_true) {
-                return this->value;
-            }
-            self = this->next;  // iterate to simulate tail-recursion
-        } while (dict_kind == self->kind);
-        return object_call(self, s_lookup, name);  // delegate call
-    } else if (cmd == s_bind) {
-        OOP name = take_arg();
-        OOP value = take_arg();
-        TRACE(fprintf(stderr, "  %p: name=%p \"%s\" value=%p\n", self, name, as_symbol(name)->s, value));
-        return dict_new(name, value, self);
-    }
-    return o_undef;
-}
-
-/*
-integer:
-    Integers are constants with a numeric representation 'n'.
-
-    boolean := o.eq?(x)         -- return true if 'o' is equal to 'x', otherwise false
-    integer := o.add(x)         -- return new integer equal to ('o' + 'x')
-*/
-
-struct symbol add_symbol = { { symbol_kind }, "add" };
-
-OOP
-integer_new(int value)
-{
-    struct integer * this = object_alloc(struct integer, integer_kind);
-    this->n = value;
-    return (OOP)this;
-}
-
-KIND(integer_kind)
-{
-    struct integer * this = as_integer(self);
-    OOP cmd = take_arg();
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        if (integer_kind == other->kind) {
-            struct integer * that = as_integer(other);
-            if (that->n == this->n) {  // compare values
-                return o_true;
-            }
-        }
-        return o_false;
-    } else if (cmd == s_add) {
-        OOP other = take_arg();
-        if (integer_kind == other->kind) {
-            struct integer * that = as_integer(other);
-            return integer_new(this->n + that->n);
-        }
-    }
-    return o_undef;
-}
-
-struct integer minus_1_integer = { { integer_kind }, -1 };
-struct integer _0_integer = { { integer_kind }, 0 };
-struct integer _1_integer = { { integer_kind }, 1 };
-struct integer _2_integer = { { integer_kind }, 2 };
+/*
+
+pair.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stdio.h>  /* for TRACE */
+#include <string.h>
+#include <limits.h>
+#include "pair.h"
+
+/*
+pair:
+    A combination of 2 object pointers.  May be treated as a list, terminated by 'o_nil'.
+
+    o' := o.push(x)             -- return a new list with 'x' at the head
+    boolean := o.empty?()       -- return true if list is empty, otherwise false
+    (x, o') := o.pop()          -- remove 'x' from the head, returning it and the new list
+*/
+
+struct symbol empty_p_symbol = { { symbol_kind }, "empty?", SEL_EMPTY_P };
+struct symbol push_symbol = { { symbol_kind }, "push", SEL_PUSH };
+struct symbol pop_symbol = { { symbol_kind }, "pop", SEL_POP };
+struct symbol put_symbol = { { symbol_kind }, "put", SEL_PUT };
+struct symbol pull_symbol = { { symbol_kind }, "pull", SEL_PULL };
+
+static KIND(nil_kind);
+
+static KIND(nil_empty_p)
+{
+    return o_true;
+}
+
+static KIND(list_push)
+{
+    OOP x = take_arg();
+    return pair_new(x, self);
+}
+
+static struct methods nil_methods = {
+    nil_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_EMPTY_P] = nil_empty_p,
+        [SEL_PUSH] = list_push,
+    }
+};
+
+static KIND(nil_kind)
+{
+    return methods_dispatch(&nil_methods, self, args);
+}
+
+struct object nil_object = { nil_kind };
+
+OOP
+pair_new(OOP h, OOP t)
+{
+    struct pair * this = object_alloc(struct pair, pair_kind);
+    this->h = h;
+    this->t = t;
+    return (OOP)this;
+}
+
+static KIND(pair_empty_p)
+{
+    return o_false;
+}
+
+static KIND(pair_pop)
+{
+    return self;
+}
+
+static struct methods pair_methods = {
+    pair_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_EMPTY_P] = pair_empty_p,
+        [SEL_POP] = pair_pop,
+        [SEL_PUSH] = list_push,
+    }
+};
+
+KIND(pair_kind)
+{
+    return methods_dispatch(&pair_methods, self, args);
+}
+
+/*
+queue:
+    An efficient mutable (stateful) queue data-structure built from pairs.
+
+    item := o.take!()           -- remove and return 'item' from the head of the queue
+    boolean := o.empty?()       -- return true if queue is empty, otherwise false
+    o := o.give!(item)          -- add 'item' to the tail of the queue
+*/
+
+struct symbol give_x_symbol = { { symbol_kind }, "give!", SEL_GIVE_X };
+struct symbol take_x_symbol = { { symbol_kind }, "take!", SEL_TAKE_X };
+
+OOP
+queue_new()
+{
+    struct pair * this = object_alloc(struct pair, queue_kind);
+    this->h = o_nil;
+    this->t = o_nil;
+    return (OOP)this;
+}
+
+static KIND(queue_empty_p)
+{
+    struct pair * this = as_pair(self);
+    if (this->h == o_nil) {
+        return o_true;
+    }
+    return o_false;
+}
+
+static KIND(queue_take_x)
+{
+    struct pair * this = as_pair(self);
+    if (this->h != o_nil) {
+        struct pair * entry = as_pair(this->h);
+        this->h = entry->t;
+        OOP item = entry->h;  // entry is garbage after this (reclaimed by gc)
+        return item;
+    }
+    return o_undef;
+}
+
+static KIND(queue_give_x)
+{
+    struct pair * this = as_pair(self);
+    OOP item = take_arg();
+    OOP oop = pair_new(item, o_nil);  // could be a custom allocator
+    if (this->h == o_nil) {
+        this->h = oop;
+    } else {
+        as_pair(this->t)->t = oop;
+    }
+    this->t = oop;
+    return self;
+}
+
+static struct methods queue_methods = {
+    queue_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_EMPTY_P] = queue_empty_p,
+        [SEL_TAKE_X] = queue_take_x,
+        [SEL_GIVE_X] = queue_give_x,
+    }
+};
+
+KIND(queue_kind)
+{
+    return methods_dispatch(&queue_methods, self, args);
+}
+
+/*
+dict:
+    Dictionaries define mappings from names to values.
+    
+    In this implementation, each node holds a single 'name'/'value' pair.
+    The 'next' pointer delegates to a linear chain of dictionaries.
+
+    x := o.lookup(name)         -- return value 'x' bound to 'name', or 'o_fail'
+    o' := o.bind(name, x)       -- return new dictionary with 'name' bound to 'x'
+*/
+
+struct symbol bind_symbol = { { symbol_kind }, "bind", SEL_BIND };
+struct symbol lookup_symbol = { { symbol_kind }, "lookup", SEL_LOOKUP };
+
+struct object fail_object = { object_kind };
+
+static KIND(empty_dict_kind);
+
+static KIND(empty_dict_lookup)
+{
+    TRACE(fprintf(stderr, "%p(empty_dict_kind)\n", self));
+    OOP name = take_arg();
+//    TRACE(fprintf(stderr, "  %p: name=%p\n", self, name));
+    TRACE(fprintf(stderr, "  %p: lookup name=%p \"%s\"\n", self, name, as_symbol(name)->s));
+    return o_fail;
+}
+
+static KIND(dict_bind)
+{
+    OOP name = take_arg();
+    OOP value = take_arg();
+//    TRACE(fprintf(stderr, "  %p: name=%p value=%p\n", self, name, value));
+    TRACE(fprintf(stderr, "%p: bind name=%p \"%s\" value=%p\n", self, name, as_symbol(name)->s, value));
+    return dict_new(name, value, self);
+}
+
+static struct methods empty_dict_methods = {
+    empty_dict_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_LOOKUP] = empty_dict_lookup,
+        [SEL_BIND] = dict_bind,
+    }
+};
+
+static KIND(empty_dict_kind)
+{
+    return methods_dispatch(&empty_dict_methods, self, args);
+}
+
+struct object empty_dict = { empty_dict_kind };
+
+OOP
+dict_new(OOP name, OOP value, OOP next)
+{
+    struct dict * this = object_alloc(struct dict, dict_kind);
+    this->name = name;
+    this->value = value;
+    this->next = next;
+    return (OOP)this;
+}
+
+static struct icache dict_lookup_icache = ICACHE_INIT("dict name eq?");
+
+static KIND(dict_lookup)
+{
+//    struct dict * this = as_dict(self);  -- moved inside "do" loop...
+    TRACE(fprintf(stderr, "%p(dict_kind)\n", self));
+    OOP name = take_arg();
+    TRACE(fprintf(stderr, "  %p: lookup name=%p \"%s\"\n", self, name, as_symbol(name)->s));
+    do {
+        struct dict * this = as_dict(self);  // init/update "this"
+        TRACE(fprintf(stderr, "  %p(dict_kind, %p, %p, %p)\n", this, this->name, this->value, this->next));
+//        if (name == this->name) {  // NOTE: identity comparison on names
+        if (icache_call1(&dict_lookup_icache, this->name, s_eq_p, name) == o_true) {
+            return this->value;
+        }
+        self = this->next;  // iterate to simulate tail-recursion
+    } while (dict_kind == self->kind);
+    return object_call(self, s_lookup, name);  // delegate call
+}
+
+static struct methods dict_methods = {
+    dict_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_LOOKUP] = dict_lookup,
+        [SEL_BIND] = dict_bind,
+    }
+};
+
+KIND(dict_kind)
+{
+    return methods_dispatch(&dict_methods, self, args);
+}
+
+/*
+hamt:
+    A hash array mapped trie is a persistent dictionary with the same protocol as 'dict'.
+
+    Each node holds a 32-bit 'bitmap' and one slot for each bit that is set.
+    At each level, 5 bits of the hash of 'name' select a bit.
+    A slot holds either a deeper node, or a 'dict' chain of bindings whose names share a full hash.
+    'bind' copies only the nodes on the path to the changed slot, sharing the rest.
+
+    x := o.lookup(name)         -- return value 'x' bound to 'name', or 'o_fail'
+    o' := o.bind(name, x)       -- return new dictionary with 'name' bound to 'x'
+
+    NOTE: Names are hashed by identity, except for integers, which are hashed by value,
+          to agree with 'eq?' on the names used in practice.
+*/
+
+#define HAMT_BITS   (5)
+#define HAMT_MASK   ((1 << HAMT_BITS) - 1)
+
+/*
+    Hash a dictionary name, consistent with 'eq?' on symbol and integer names.
+*/
+size_t
+dict_hash(OOP name)
+{
+    size_t h = (integer_kind == kind_of(name))
+        ? (size_t)integer_value(name)
+        : (size_t)name;
+    h *= (size_t)0x9E3779B97F4A7C15ULL;  // Fibonacci hashing
+    return h ^ (h >> 29);
+}
+
+static OOP
+hamt_alloc(uint32_t bitmap)
+{
+    int n = __builtin_popcount(bitmap);
+    struct hamt * this = (struct hamt *)object_new(hamt_kind, sizeof(struct hamt) + n * sizeof(OOP));
+    this->bitmap = bitmap;
+    return (OOP)this;
+}
+
+/*
+    Return a node (or chain of nodes) holding both 'a' and 'b', whose hashes differ.
+*/
+static OOP
+hamt_split(OOP a, size_t ha, OOP b, size_t hb, int shift)
+{
+    uint32_t bit_a = (uint32_t)1 << ((ha >> shift) & HAMT_MASK);
+    uint32_t bit_b = (uint32_t)1 << ((hb >> shift) & HAMT_MASK);
+    if (bit_a == bit_b) {
+        struct hamt * this = as_hamt(hamt_alloc(bit_a));
+        this->slot[0] = hamt_split(a, ha, b, hb, shift + HAMT_BITS);
+        return (OOP)this;
+    }
+    struct hamt * this = as_hamt(hamt_alloc(bit_a | bit_b));
+    this->slot[(bit_a < bit_b) ? 0 : 1] = a;
+    this->slot[(bit_a < bit_b) ? 1 : 0] = b;
+    return (OOP)this;
+}
+
+static OOP
+hamt_insert(OOP node, size_t h, int shift, OOP name, OOP value)
+{
+    struct hamt * this = as_hamt(node);
+    uint32_t bit = (uint32_t)1 << ((h >> shift) & HAMT_MASK);
+    int i = __builtin_popcount(this->bitmap & (bit - 1));
+    int n = __builtin_popcount(this->bitmap);
+    if ((this->bitmap & bit) == 0) {  // new slot
+        struct hamt * copy = as_hamt(hamt_alloc(this->bitmap | bit));
+        memcpy(copy->slot, this->slot, i * sizeof(OOP));
+        copy->slot[i] = dict_new(name, value, o_empty_dict);
+        memcpy(copy->slot + i + 1, this->slot + i, (n - i) * sizeof(OOP));
+        return (OOP)copy;
+    }
+    OOP child = this->slot[i];
+    if (hamt_kind == child->kind) {
+        child = hamt_insert(child, h, shift + HAMT_BITS, name, value);
+    } else {
+        struct dict * leaf = as_dict(child);
+        size_t h_leaf = dict_hash(leaf->name);
+        if (h_leaf == h) {  // same hash, extend the chain
+            if ((leaf->next == o_empty_dict)
+            &&  (object_call(leaf->name, s_eq_p, name) == o_true)) {
+                child = dict_new(name, value, o_empty_dict);  // replace sole binding
+            } else {
+                child = dict_new(name, value, child);  // shadow earlier bindings
+            }
+        } else {
+            child = hamt_split(child, h_leaf,
+                dict_new(name, value, o_empty_dict), h, shift + HAMT_BITS);
+        }
+    }
+    struct hamt * copy = as_hamt(hamt_alloc(this->bitmap));
+    memcpy(copy->slot, this->slot, n * sizeof(OOP));
+    copy->slot[i] = child;
+    return (OOP)copy;
+}
+
+static KIND(hamt_bind)
+{
+    OOP name = take_arg();
+    OOP value = take_arg();
+    TRACE(fprintf(stderr, "%p: hamt bind name=%p value=%p\n", self, name, value));
+    return hamt_insert(self, dict_hash(name), 0, name, value);
+}
+
+static KIND(hamt_lookup)
+{
+    TRACE(fprintf(stderr, "%p(hamt_kind)\n", self));
+    OOP name = take_arg();
+    size_t h = dict_hash(name);
+    int shift = 0;
+    do {
+        struct hamt * this = as_hamt(self);  // init/update "this"
+        uint32_t bit = (uint32_t)1 << ((h >> shift) & HAMT_MASK);
+        if ((this->bitmap & bit) == 0) {
+            return o_fail;
+        }
+        self = this->slot[__builtin_popcount(this->bitmap & (bit - 1))];
+        shift += HAMT_BITS;
+    } while (hamt_kind == self->kind);
+    return object_call(self, s_lookup, name);  // delegate to binding chain
+}
+
+static struct methods hamt_methods = {
+    hamt_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_LOOKUP] = hamt_lookup,
+        [SEL_BIND] = hamt_bind,
+    }
+};
+
+KIND(hamt_kind)
+{
+    return methods_dispatch(&hamt_methods, self, args);
+}
+
+struct hamt empty_hamt = { { hamt_kind }, 0 };
+
+/*
+integer:
+    Integers are constants with a numeric representation 'n'.
+
+    Integers within the fixnum range are immediate (tagged) values, which allocate nothing.
+    With 64-bit words that is every 'int'. With narrower words, the extremes are boxed in a 'struct integer'.
+
+    boolean := o.eq?(x)         -- return true if 'o' is equal to 'x', otherwise false
+    integer := o.add(x)         -- return new integer equal to ('o' + 'x')
+*/
+
+struct symbol add_symbol = { { symbol_kind }, "add", SEL_ADD };
+
+OOP
+integer_new(int value)
+{
+#if (INT_MAX > FIXNUM_MAX)
+    if ((value < FIXNUM_MIN) || (value > FIXNUM_MAX)) {  // too wide for a tagged word
+        struct integer * this = object_alloc(struct integer, integer_kind);
+        this->n = value;
+        return (OOP)this;
+    }
+#endif
+    return fixnum_new(value);
+}
+
+KIND(integer_kind)
+{
+    int n = integer_value(self);
+    OOP cmd = take_arg();
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        if (integer_kind == kind_of(other)) {
+            if (integer_value(other) == n) {  // compare values
+                return o_true;
+            }
+        }
+        return o_false;
+    } else if (cmd == s_add) {
+        OOP other = take_arg();
+        if (integer_kind == kind_of(other)) {
+            return integer_new(n + integer_value(other));
+        }
+    }
+    return o_undef;
+}
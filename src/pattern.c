@@ -1,823 +1,1246 @@
-/*
-
-pattern.c -- Actor Run-Time
-
-"MIT License"
-
-Copyright (c) 2013 Dale Schumacher, Tristan Slominski
-
-Permission is hereby granted, free of charge, to any person obtaining a copy
-of this software and associated documentation files (the "Software"), to deal
-in the Software without restriction, including without limitation the rights
-to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
-copies of the Software, and to permit persons to whom the Software is
-furnished to do so, subject to the following conditions:
-
-The above copyright notice and this permission notice shall be included in
-all copies or substantial portions of the Software.
-
-THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
-IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
-FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
-AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
-LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
-THE SOFTWARE.
-
-*/
-
-#include <stdio.h>  /* for TRACE */
-#include "pattern.h"
-#include "pair.h"
-
-/*
-match:
-    Matches represent composable contexts for pattern matching.
-
-    (in, env, out) -> (in', env', out') | #fail
-*/
-
-OOP
-match_new(OOP in, OOP env, OOP out)
-{
-    struct match * this = object_alloc(struct match, match_kind);
-    this->in = in;
-    this->env = env;
-    this->out = out;
-    return (OOP)this;
-}
-
-KIND(match_kind)
-{
-    OOP cmd = take_arg();
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    }
-    return o_undef;
-}
-
-/*
-pattern:
-    Patterns are used to match structured values, possibly binding identifiers to the components.
-
-    match_out := o.match(match_in)    -- return the result of matching pattern to 'match_in', or 'o_fail'
-*/
-
-struct symbol match_symbol = { { symbol_kind }, "match" };
-
-/* LET fail = \in.(#fail, in) */
-static KIND(fail_pattern_kind)
-{
-    TRACE(fprintf(stderr, "%p(fail_pattern_kind)\n", self));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        struct match * mp = as_match(match);
-        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-        return o_fail;
-    }
-    return o_undef;
-}
-struct object fail_pattern = { fail_pattern_kind };
-
-/* LET empty = \in.(#ok, (), in) */
-static KIND(empty_pattern_kind)
-{
-    TRACE(fprintf(stderr, "%p(empty_pattern_kind)\n", self));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        struct match * mp = as_match(match);
-        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-        return match_new(mp->in, mp->env, o_nil);
-    }
-    return o_undef;
-}
-struct object empty_pattern = { empty_pattern_kind };
-
-/* LET all = \in.(#ok, in, in) */
-static KIND(all_pattern_kind)
-{
-    TRACE(fprintf(stderr, "%p(all_pattern_kind)\n", self));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        struct match * mp = as_match(match);
-        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-        return match_new(mp->in, mp->env, mp->in);
-    }
-    return o_undef;
-}
-struct object all_pattern = { all_pattern_kind };
-
-/* LET end = \in.(
-    CASE in OF
-    () : (#ok, (), in)
-    _ : (#fail, in)
-    END
-) */
-static KIND(end_pattern_kind)
-{
-    TRACE(fprintf(stderr, "%p(end_pattern_kind)\n", self));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        struct match * mp = as_match(match);
-        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-        if (object_call(mp->in, s_empty_p) == o_true) {
-            return match_new(mp->in, mp->env, o_nil);
-        }
-        return o_fail;
-    }
-    return o_undef;
-}
-struct object end_pattern = { end_pattern_kind };
-
-/* LET any = \in.(
-    CASE in OF
-    () : (#fail, in)
-    (token, rest) : (#ok, token, rest)
-    END
-) */
-static KIND(any_pattern_kind)
-{
-    TRACE(fprintf(stderr, "%p(any_pattern_kind)\n", self));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        struct match * mp = as_match(match);
-        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-        if (object_call(mp->in, s_empty_p) == o_false) {
-            struct pair * pp = as_pair(object_call(mp->in, s_pop));
-            return match_new(pp->t, mp->env, pp->h);
-        }
-        return o_fail;
-    }
-    return o_undef;
-}
-struct object any_pattern = { any_pattern_kind };
-
-OOP
-eq_pattern_new(OOP value)
-{
-    struct eq_pattern * this = object_alloc(struct eq_pattern, eq_pattern_kind);
-    this->value = value;
-    return (OOP)this;
-}
-/* LET eq(value) = \in.(
-    CASE in OF
-    () : (#fail, in)
-    ($value, rest) : (#ok, value, rest)
-    _ : (#fail, in)
-    END
-) */
-KIND(eq_pattern_kind)
-{
-    struct eq_pattern * this = as_eq_pattern(self);
-    TRACE(fprintf(stderr, "%p(eq_pattern_kind, %p)\n", this, this->value));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        struct match * mp = as_match(match);
-        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-        if (object_call(mp->in, s_empty_p) == o_false) {
-            struct pair * pp = as_pair(object_call(mp->in, s_pop));
-            if (integer_kind == pp->h->kind) {  // FIXME: REMOVE DEBUGGING OUTPUT
-                int ch = as_integer(pp->h)->n;
-                TRACE(fprintf(stderr, "  %p: ch@%p #%d '%c'\n", self, pp->h, ch, ch));
-            }
-            if (object_call(this->value, s_eq_p, pp->h) == o_true) {
-                return match_new(pp->t, mp->env, pp->h);
-            }
-        }
-        return o_fail;
-    }
-    return o_undef;
-}
-
-OOP
-if_pattern_new(OOP test)
-{
-    struct if_pattern * this = object_alloc(struct if_pattern, if_pattern_kind);
-    this->test = test;
-    return (OOP)this;
-}
-/* LET if(test) = \in.(
-    CASE in OF
-    () : (#fail, in)
-    (token, rest) : (
-        CASE test(token) OF
-        TRUE : (#ok, token, rest)
-        _ : (#fail, in)
-        END
-    )
-    END
-) */
-KIND(if_pattern_kind)
-{
-    struct if_pattern * this = as_if_pattern(self);
-    TRACE(fprintf(stderr, "%p(if_pattern_kind, %p)\n", this, this->test));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        struct match * mp = as_match(match);
-        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-        if (object_call(mp->in, s_empty_p) == o_false) {
-            struct pair * pp = as_pair(object_call(mp->in, s_pop));
-            if (integer_kind == pp->h->kind) {  // FIXME: REMOVE DEBUGGING OUTPUT
-                int ch = as_integer(pp->h)->n;
-                TRACE(fprintf(stderr, "  %p: ch@%p #%d '%c'\n", self, pp->h, ch, ch));
-            }
-            if (object_call(this->test, pp->h) == o_true) {        // FIXME: IS THIS THE RIGHT PROTOCOL FOR PREDICATE FUNCTIONS?
-                return match_new(pp->t, mp->env, pp->h);
-            }
-        }
-        return o_fail;
-    }
-    return o_undef;
-}
-
-OOP
-charset_p_new(char * set)
-{
-    struct charset_p * this = object_alloc(struct charset_p, charset_p_kind);
-    this->s = set;
-    return (OOP)this;
-}
-KIND(charset_p_kind)
-{
-    struct charset_p * this = as_charset_p(self);
-    OOP cmd = take_arg();
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (integer_kind == cmd->kind) {        // FIXME: IS THIS THE RIGHT PROTOCOL FOR PREDICATE FUNCTIONS?
-        char * s;
-        int c = as_integer(cmd)->n;
-        for (s = this->s; *s; ++s) {
-            if (c == *s) {
-                return o_true;
-            }
-        }
-        return o_false;
-    }
-    return o_undef;
-}
-
-OOP
-exclset_p_new(char * excl)
-{
-    struct charset_p * this = object_alloc(struct charset_p, exclset_p_kind);
-    this->s = excl;
-    return (OOP)this;
-}
-KIND(exclset_p_kind)
-{
-    OOP result = charset_p_kind(self, args);  // delegate without consuming any arguments
-    if (o_true == result) {
-        return o_false;
-    }
-    if (o_false == result) {
-        return o_true;
-    }
-    return o_undef;
-}
-
-OOP
-or_pattern_new(OOP head, OOP tail)
-{
-    struct or_pattern * this = object_alloc(struct or_pattern, or_pattern_kind);
-    this->head = head;
-    this->tail = tail;
-    return (OOP)this;
-}
-/* LET or(left, right) = \in.(
-    CASE left(in) OF
-    (#ok, value, in') : (#ok, value, in')
-    (#fail, in') : right(in)
-    END
-) */
-KIND(or_pattern_kind)
-{
-//    struct or_pattern * this = as_or_pattern(self);  -- moved inside loop...
-    TRACE(fprintf(stderr, "%p(or_pattern_kind)\n", self));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        struct match * mp = as_match(match);
-        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-        do {
-            struct or_pattern * this = as_or_pattern(self);
-            TRACE(fprintf(stderr, "%p(or_pattern_kind, %p, %p)\n", this, this->head, this->tail));
-            OOP match1 = object_call(this->head, s_match, match);
-            if (match_kind == match1->kind) {
-                return match1;  // success
-            }
-            self = this->tail;  // simulate tail-recursion
-        } while (or_pattern_kind == self->kind);
-        return object_call(self, s_match, match);
-    }
-    return o_undef;
-}
-
-OOP
-and_pattern_new(OOP head, OOP tail)
-{
-    struct and_pattern * this = object_alloc(struct and_pattern, and_pattern_kind);
-    this->head = head;
-    this->tail = tail;
-    return (OOP)this;
-}
-/* LET and(left, right) = \in.(
-    CASE left(in) OF
-    (#fail, in') : (#fail, in)
-    (#ok, value, in') : (
-        CASE right(in') OF
-        (#fail, in'') : (#fail, in)
-        (#ok, value', in'') : (#ok, (value, value'), in'')
-        END
-    )
-    END
-) */
-KIND(and_pattern_kind)
-{
-    struct and_pattern * this = as_and_pattern(self);
-    TRACE(fprintf(stderr, "%p(and_pattern_kind, %p, %p)\n", this, this->head, this->tail));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        struct match * mp = as_match(match);
-        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-        OOP match1 = object_call(this->head, s_match, match);
-        if (match_kind == match1->kind) {
-            struct match * mp1 = as_match(match1);
-            OOP match2 = object_call(this->tail, s_match, match1);
-            if (match_kind == match2->kind) {
-                struct match * mp2 = as_match(match2);
-                OOP out = pair_new(mp1->out, mp2->out);
-                return match_new(mp2->in, mp2->env, out);
-            }
-        }
-        return o_fail;
-    }
-    return o_undef;
-}
-
-OOP
-bind_pattern_new(OOP name, OOP ptrn)
-{
-    struct bind_pattern * this = object_alloc(struct bind_pattern, bind_pattern_kind);
-    this->name = name;
-    this->ptrn = ptrn;
-    return (OOP)this;
-}
-/* LET bind(name, ptrn) = \(value, env, in).(
-    CASE ptrn(value, env, in) OF
-    (#ok, value', env', in') : (#ok, value', env'.bind(name, value'), in')
-    (#fail, value', env', in') : (#fail, value, env, in)
-    END
-) */
-KIND(bind_pattern_kind)
-{
-    struct bind_pattern * this = as_bind_pattern(self);
-    TRACE(fprintf(stderr, "%p(bind_pattern_kind, %p, %p)\n", this, this->name, this->ptrn));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        struct match * mp = as_match(match);
-        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-        OOP match1 = object_call(this->ptrn, s_match, match);
-        if (match_kind == match1->kind) {
-            struct match * mp1 = as_match(match1);
-            OOP env = object_call(mp1->env, s_bind, this->name, mp1->out);
-            return match_new(mp1->in, env, mp1->out);
-        }
-        return o_fail;
-    }
-    return o_undef;
-}
-
-/*
-input = "2#1011.\n"
-digit = '0' | '1'
-digits = digit digits | digit
-grammar = any '#' digits
-*/
-
-/* LET alt(matches) = (
-    CASE matches OF
-    () : fail
-    (first, rest) : or(first, alt(rest))
-    last : last
-    END
-) */
-
-/* LET seq(matches) = (
-    CASE matches OF
-    () : empty
-    (first, rest) : and(first, seq(rest))
-    last : last
-    END
-) */
-
-/* LET opt(match) = or(match, empty) */
-OOP
-opt_pattern_new(OOP ptrn)
-{
-    return or_pattern_new(ptrn, ptrn_empty);
-}
-
-/* LET star(match) = \in.((opt(and(match, star(match))))(in)) */
-OOP
-star_pattern_new(OOP ptrn)
-{
-    struct ref_pattern * this = object_alloc(struct ref_pattern, star_pattern_kind);
-    this->ptrn = ptrn;
-    return (OOP)this;
-}
-KIND(star_pattern_kind)
-{
-    struct ref_pattern * this = as_ref_pattern(self);
-    TRACE(fprintf(stderr, "%p(star_pattern_kind, %p)\n", this, this->ptrn));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_match) {
-        OOP match = take_arg();
-        for(;;) {
-            struct match * mp = as_match(match);
-            TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
-            OOP match1 = object_call(this->ptrn, s_match, match);
-            if (match_kind != match1->kind) {
-                return match;  // previous success
-            }
-            match = match1;  // advance match state
-        }
-    }
-    return o_undef;
-}
-
-/* LET plus(match) = and(match, star(match)) */
-OOP
-plus_pattern_new(OOP ptrn)
-{
-    return and_pattern_new(ptrn, star_pattern_new(ptrn));
-}
-
-/* LET not(match) = \in.(
-    CASE match(in) OF
-    (#ok, value, in') : (#fail, in)
-    (#fail, in') : (#ok, (), in)
-    END
-) */
-
-/* LET peek(match) = not(not(match)) */
-
-/*
-expr:
-    Expressions represent procedures for computing a value.
-    
-    value := o.eval(env)        -- return result of evaluating this expression in environment 'env'
-*/
-
-struct symbol eval_symbol = { { symbol_kind }, "eval" };
-struct symbol combine_symbol = { { symbol_kind }, "combine" };
-
-// "bottom" represents the inability to determine a result when evaluating an expression
-struct object bottom_object = { object_kind };
-
-KIND(const_expr_kind)
-{
-    TRACE(fprintf(stderr, "%p(const_expr_kind)\n", self));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_eval) {
-        OOP env = take_arg();  // constants evaluate to themselves
-        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
-        return self;
-    }
-    return o_undef;
-}
-
-OOP
-ident_expr_new(OOP name)
-{
-    struct ident_expr * this = object_alloc(struct ident_expr, ident_expr_kind);
-    this->name = name;
-    return (OOP)this;
-}
-KIND(ident_expr_kind)
-{
-    struct ident_expr * this = as_ident_expr(self);
-    TRACE(fprintf(stderr, "%p(ident_expr_kind, %p \"%s\")\n", this, this->name, as_symbol(this->name)->s));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_eval) {
-        OOP env = take_arg();
-        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
-        return object_call(env, s_lookup, this->name);
-    }
-    return o_undef;
-}
-
-OOP
-combine_expr_new(OOP oper, OOP opnd)
-{
-    struct combine_expr * this = object_alloc(struct combine_expr, combine_expr_kind);
-    this->oper = oper;
-    this->opnd = opnd;
-    return (OOP)this;
-}
-KIND(combine_expr_kind)
-{
-    struct combine_expr * this = as_combine_expr(self);
-    TRACE(fprintf(stderr, "%p(combine_expr_kind, %p, %p)\n", this, this->oper, this->opnd));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_eval) {
-        OOP env = take_arg();
-        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
-        OOP comb = object_call(this->oper, s_eval, env);  // evaluate oper (in env) to yield combiner
-        TRACE(fprintf(stderr, "  %p: combiner=%p\n", self, comb));
-        return object_call(comb, s_combine, this->opnd, env);  // send operand to combiner (with env)
-    }
-    return o_undef;
-}
-
-OOP
-appl_expr_new(OOP comb)
-{
-    struct appl_expr * this = object_alloc(struct appl_expr, appl_expr_kind);
-    this->comb = comb;
-    return (OOP)this;
-}
-KIND(appl_expr_kind)
-{
-    struct appl_expr * this = as_appl_expr(self);
-    TRACE(fprintf(stderr, "%p(appl_expr_kind, %p)\n", this, this->comb));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_eval) {
-        OOP env = take_arg();
-        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
-        return self;  // applicatives evaluate to themselves
-    } else if (cmd == s_combine) {
-        OOP opnd = take_arg();
-        OOP env = take_arg();
-        TRACE(fprintf(stderr, "  %p: combine {opnd:%p env:%p}\n", self, opnd, env));
-        OOP arg = object_call(opnd, s_eval, env);  // evaluate opnd (in env) to yield argument
-        TRACE(fprintf(stderr, "  %p: arg=%p\n", self, arg));
-        return object_call(this->comb, s_combine, arg, env);  // send arg to combiner (with env)
-    }
-    return o_undef;
-}
-
-OOP
-thunk_expr_new(OOP env, OOP ptrn, OOP expr)
-{
-    struct thunk_expr * this = object_alloc(struct thunk_expr, thunk_expr_kind);
-    this->env = env;
-    this->ptrn = ptrn;
-    this->expr = expr;
-    return (OOP)this;
-}
-KIND(thunk_expr_kind)
-{
-    struct thunk_expr * this = as_thunk_expr(self);
-    TRACE(fprintf(stderr, "%p(thunk_expr_kind, %p, %p, %p)\n", this, this->env, this->ptrn, this->expr));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_eval) {
-        OOP env = take_arg();
-        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
-        return self;  // closures evaluate to themselves
-    } else if (cmd == s_combine) {
-        OOP opnd = take_arg();
-        OOP denv = take_arg();        // dynamic environment (ignored)
-        TRACE(fprintf(stderr, "  %p: combine {opnd:%p denv:%p}\n", self, opnd, denv));
-        OOP match = match_new(opnd, this->env, o_undef);
-        match = object_call(this->ptrn, s_match, match);
-        if (match_kind == match->kind) {
-            struct match * mp = as_match(match);
-            TRACE(fprintf(stderr, "  %p: env'=%p\n", self, mp->env));
-            return object_call(this->expr, s_eval, mp->env);  // evaluate body in extended environment
-        }
-        return o_bottom;  // parameter pattern mismatch
-    }
-    return o_undef;
-}
-
-OOP
-lambda_expr_new(OOP ptrn, OOP expr)
-{
-    struct lambda_expr * this = object_alloc(struct lambda_expr, lambda_expr_kind);
-    this->ptrn = ptrn;
-    this->expr = expr;
-    return (OOP)this;
-}
-KIND(lambda_expr_kind)
-{
-    struct lambda_expr * this = as_lambda_expr(self);
-    TRACE(fprintf(stderr, "%p(lambda_expr_kind, %p, %p)\n", this, this->ptrn, this->expr));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_eval) {
-        OOP env = take_arg();
-        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
-        OOP oper = thunk_expr_new(env, this->ptrn, this->expr);
-        TRACE(fprintf(stderr, "  %p: oper=%p\n", self, oper));
-        return appl_expr_new(oper);
-    }
-    return o_undef;
-}
-
-OOP
-oper_expr_new(OOP env, OOP ptrn, OOP evar, OOP expr)
-{
-    struct oper_expr * this = object_alloc(struct oper_expr, oper_expr_kind);
-    this->env = env;
-    this->ptrn = ptrn;
-    this->evar = evar;
-    this->expr = expr;
-    return (OOP)this;
-}
-KIND(oper_expr_kind)
-{
-    struct oper_expr * this = as_oper_expr(self);
-    TRACE(fprintf(stderr, "%p(oper_expr_kind, %p, %p, %p, %p)\n", this, this->env, this->ptrn, this->evar, this->expr));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_eval) {
-        OOP env = take_arg();
-        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
-        return self;  // operatives evaluate to themselves
-    } else if (cmd == s_combine) {
-        OOP opnd = take_arg();
-        OOP denv = take_arg();        // dynamic environment
-        TRACE(fprintf(stderr, "  %p: combine {opnd:%p denv:%p}\n", self, opnd, denv));
-        OOP match = match_new(opnd, this->env, o_undef);
-        match = object_call(this->ptrn, s_match, match);
-        if (match_kind == match->kind) {
-            OOP env = as_match(match)->env;
-            TRACE(fprintf(stderr, "  %p: env'=%p\n", self, env));
-            if (symbol_kind == this->evar->kind) {
-                env = object_call(env, s_bind, this->evar, denv);  // bind dynamic environment
-                TRACE(fprintf(stderr, "  %p: env''=%p\n", self, env));
-            }
-            return object_call(this->expr, s_eval, env);  // evaluate body in extended environment
-        }
-        return o_bottom;  // parameter pattern mismatch
-    }
-    return o_undef;
-}
-
-OOP
-quote_expr_new(OOP value)
-{
-    struct quote_expr * this = object_alloc(struct quote_expr, quote_expr_kind);
-    this->value = value;
-    return (OOP)this;
-}
-KIND(quote_expr_kind)
-{
-    struct quote_expr * this = as_quote_expr(self);
-    TRACE(fprintf(stderr, "%p(quote_expr_kind, %p)\n", this, this->value));
-    OOP cmd = take_arg();
-    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
-    if (cmd == s_eq_p) {
-        OOP other = take_arg();
-        if (other == self) {  // compare identities
-            return o_true;
-        }
-        return o_false;
-    } else if (cmd == s_eval) {
-        OOP env = take_arg();
-        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
-        return this->value;
-    }
-    return o_undef;
-}
+/*
+
+pattern.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stdio.h>  /* for TRACE */
+#include <stdint.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "pattern.h"
+#include "pair.h"
+#include "json.h"
+#include "gc.h"
+
+/*
+match:
+    Matches represent composable contexts for pattern matching.
+
+    (in, env, out) -> (in', env', out') | #fail
+
+    While matching a string stream, the position is kept as a cursor ('at') into its string,
+    and 'in' stays at the stream the cursor started from, so 'any', 'eq', 'if' (and runs of 'if')
+    take characters without allocating. 'match_in' makes the stream for the cursor,
+    only when a pattern needs 'in' itself (such as 'all', a memoized rule, or the final result).
+*/
+
+OOP
+match_new(OOP in, OOP env, OOP out)
+{
+    struct match * this = object_alloc(struct match, match_kind);
+    this->in = in;
+    this->env = env;
+    this->out = out;
+    this->at = NULL;
+    return (OOP)this;
+}
+
+/*
+    Return the input of 'mp', first making the stream for its cursor (if any).
+*/
+OOP
+match_in(struct match * mp)
+{
+    if (mp->at != NULL) {
+        mp->in = string_stream_seek(mp->in, mp->at);
+        mp->at = NULL;
+    }
+    return mp->in;
+}
+
+/*
+    Return the cursor of 'mp', starting one if 'in' is a string stream, or NULL for other inputs.
+*/
+static char *
+match_cursor(struct match * mp)
+{
+    if ((mp->at == NULL) && (string_stream_kind == kind_of(mp->in))) {
+        mp->at = as_string_stream(mp->in)->s;  // the same position
+    }
+    return mp->at;
+}
+
+KIND(match_kind)
+{
+    OOP cmd = take_arg();
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    }
+    return o_undef;
+}
+
+/*
+pattern:
+    Patterns are used to match structured values, possibly binding identifiers to the components.
+
+    match_out := o.match(match_in)    -- return the result of matching pattern to 'match_in', or 'o_fail'
+    ok := o.match!(state)             -- match pattern to 'state', updating it in place, return 'o_true' or 'o_false'
+
+    The 'match!' protocol threads a single caller-owned 'struct match' (often on the C stack) through
+    the pattern graph, so no match records are allocated while matching. A pattern that succeeds
+    advances the state; a pattern that fails leaves it as it was. Every pattern implements 'match'
+    with 'pattern_match', which copies 'match_in' to a local state, and only allocates 'match_out'
+    for a successful match.
+*/
+
+struct symbol match_symbol = { { symbol_kind }, "match", SEL_MATCH };
+struct symbol match_x_symbol = { { symbol_kind }, "match!", SEL_MATCH_X };
+struct symbol span_symbol = { { symbol_kind }, "span", SEL_SPAN };
+
+KIND(pattern_match)
+{
+    OOP match = take_arg();
+    struct match state = *as_match(match);  // caller-owned state
+    if (object_call(self, s_match_x, (OOP)&state) == o_true) {
+        return match_new(match_in(&state), state.env, state.out);
+    }
+    return o_fail;
+}
+
+#define PATTERN_METHODS(kind, match_x) { (kind), NULL, { \
+    [SEL_EQ_P] = object_eq_p, [SEL_MATCH] = pattern_match, [SEL_MATCH_X] = (match_x) } }
+
+/* LET fail = \in.(#fail, in) */
+static KIND(fail_pattern_kind);
+
+static KIND(fail_pattern_match_x)
+{
+    TRACE(fprintf(stderr, "%p(fail_pattern_kind)\n", self));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    return o_false;
+}
+
+static struct methods fail_pattern_methods = PATTERN_METHODS(fail_pattern_kind, fail_pattern_match_x);
+
+static KIND(fail_pattern_kind)
+{
+    return methods_dispatch(&fail_pattern_methods, self, args);
+}
+struct object fail_pattern = { fail_pattern_kind };
+
+/* LET empty = \in.(#ok, (), in) */
+static KIND(empty_pattern_kind);
+
+static KIND(empty_pattern_match_x)
+{
+    TRACE(fprintf(stderr, "%p(empty_pattern_kind)\n", self));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    mp->out = o_nil;
+    return o_true;
+}
+
+static struct methods empty_pattern_methods = PATTERN_METHODS(empty_pattern_kind, empty_pattern_match_x);
+
+static KIND(empty_pattern_kind)
+{
+    return methods_dispatch(&empty_pattern_methods, self, args);
+}
+struct object empty_pattern = { empty_pattern_kind };
+
+/* LET all = \in.(#ok, in, in) */
+static KIND(all_pattern_kind);
+
+static KIND(all_pattern_match_x)
+{
+    TRACE(fprintf(stderr, "%p(all_pattern_kind)\n", self));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    mp->out = match_in(mp);
+    return o_true;
+}
+
+static struct methods all_pattern_methods = PATTERN_METHODS(all_pattern_kind, all_pattern_match_x);
+
+static KIND(all_pattern_kind)
+{
+    return methods_dispatch(&all_pattern_methods, self, args);
+}
+struct object all_pattern = { all_pattern_kind };
+
+/* LET end = \in.(
+    CASE in OF
+    () : (#ok, (), in)
+    _ : (#fail, in)
+    END
+) */
+static KIND(end_pattern_kind);
+
+static KIND(end_pattern_match_x)
+{
+    TRACE(fprintf(stderr, "%p(end_pattern_kind)\n", self));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    char * at = match_cursor(mp);
+    if ((at != NULL) ? (*at == '\0') : (object_call(mp->in, s_empty_p) == o_true)) {
+        mp->out = o_nil;
+        return o_true;
+    }
+    return o_false;
+}
+
+static struct methods end_pattern_methods = PATTERN_METHODS(end_pattern_kind, end_pattern_match_x);
+
+static KIND(end_pattern_kind)
+{
+    return methods_dispatch(&end_pattern_methods, self, args);
+}
+struct object end_pattern = { end_pattern_kind };
+
+/* LET any = \in.(
+    CASE in OF
+    () : (#fail, in)
+    (token, rest) : (#ok, token, rest)
+    END
+) */
+static KIND(any_pattern_kind);
+
+static KIND(any_pattern_match_x)
+{
+    TRACE(fprintf(stderr, "%p(any_pattern_kind)\n", self));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    char * at = match_cursor(mp);
+    if (at != NULL) {
+        if (*at == '\0') {
+            return o_false;
+        }
+        mp->out = integer_new(*at);
+        mp->at = at + 1;
+        return o_true;
+    }
+    if (object_call(mp->in, s_empty_p) == o_false) {
+        struct pair * pp = as_pair(object_call(mp->in, s_pop));
+        mp->out = pp->h;
+        mp->in = pp->t;
+        return o_true;
+    }
+    return o_false;
+}
+
+static struct methods any_pattern_methods = PATTERN_METHODS(any_pattern_kind, any_pattern_match_x);
+
+static KIND(any_pattern_kind)
+{
+    return methods_dispatch(&any_pattern_methods, self, args);
+}
+struct object any_pattern = { any_pattern_kind };
+
+OOP
+eq_pattern_new(OOP value)
+{
+    struct eq_pattern * this = object_alloc(struct eq_pattern, eq_pattern_kind);
+    this->value = value;
+    return (OOP)this;
+}
+/* LET eq(value) = \in.(
+    CASE in OF
+    () : (#fail, in)
+    ($value, rest) : (#ok, value, rest)
+    _ : (#fail, in)
+    END
+) */
+static KIND(eq_pattern_match_x)
+{
+    struct eq_pattern * this = as_eq_pattern(self);
+    TRACE(fprintf(stderr, "%p(eq_pattern_kind, %p)\n", this, this->value));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    char * at = match_cursor(mp);
+    if (at != NULL) {
+        if (*at == '\0') {
+            return o_false;
+        }
+        OOP ch = integer_new(*at);
+        TRACE(fprintf(stderr, "  %p: ch@%p #%d '%c'\n", self, ch, *at, *at));
+        if ((this->value == ch)  // identical tokens (such as fixnums) are equal
+        ||  (object_call(this->value, s_eq_p, ch) == o_true)) {
+            mp->out = ch;
+            mp->at = at + 1;
+            return o_true;
+        }
+        return o_false;
+    }
+    if (object_call(mp->in, s_empty_p) == o_false) {
+        struct pair * pp = as_pair(object_call(mp->in, s_pop));
+        if (integer_kind == kind_of(pp->h)) {  // FIXME: REMOVE DEBUGGING OUTPUT
+            int ch = integer_value(pp->h);
+            TRACE(fprintf(stderr, "  %p: ch@%p #%d '%c'\n", self, pp->h, ch, ch));
+        }
+        if (object_call(this->value, s_eq_p, pp->h) == o_true) {
+            mp->out = pp->h;
+            mp->in = pp->t;
+            return o_true;
+        }
+    }
+    return o_false;
+}
+
+static struct methods eq_pattern_methods = PATTERN_METHODS(eq_pattern_kind, eq_pattern_match_x);
+
+KIND(eq_pattern_kind)
+{
+    return methods_dispatch(&eq_pattern_methods, self, args);
+}
+
+OOP
+if_pattern_new(OOP test)
+{
+    struct if_pattern * this = object_alloc(struct if_pattern, if_pattern_kind);
+    this->test = test;
+    return (OOP)this;
+}
+/* LET if(test) = \in.(
+    CASE in OF
+    () : (#fail, in)
+    (token, rest) : (
+        CASE test(token) OF
+        TRUE : (#ok, token, rest)
+        _ : (#fail, in)
+        END
+    )
+    END
+) */
+static KIND(if_pattern_match_x)
+{
+    struct if_pattern * this = as_if_pattern(self);
+    TRACE(fprintf(stderr, "%p(if_pattern_kind, %p)\n", this, this->test));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    char * at = match_cursor(mp);
+    if (at != NULL) {
+        if (*at == '\0') {
+            return o_false;
+        }
+        OOP ch = integer_new(*at);
+        TRACE(fprintf(stderr, "  %p: ch@%p #%d '%c'\n", self, ch, *at, *at));
+        if ((charset_p_kind == this->test->kind)
+            ? charset_member(as_charset_p(this->test), *at)  // bit test, no dispatch
+            : (object_call(this->test, ch) == o_true)) {
+            mp->out = ch;
+            mp->at = at + 1;
+            return o_true;
+        }
+        return o_false;
+    }
+    if (object_call(mp->in, s_empty_p) == o_false) {
+        struct pair * pp = as_pair(object_call(mp->in, s_pop));
+        if (integer_kind == kind_of(pp->h)) {  // FIXME: REMOVE DEBUGGING OUTPUT
+            int ch = integer_value(pp->h);
+            TRACE(fprintf(stderr, "  %p: ch@%p #%d '%c'\n", self, pp->h, ch, ch));
+        }
+        int ok;
+        if (is_fixnum(pp->h) && (charset_p_kind == this->test->kind)) {
+            ok = charset_member(as_charset_p(this->test), fixnum_value(pp->h));  // bit test, no dispatch
+        } else {
+            ok = (object_call(this->test, pp->h) == o_true);        // FIXME: IS THIS THE RIGHT PROTOCOL FOR PREDICATE FUNCTIONS?
+        }
+        if (ok) {
+            mp->out = pp->h;
+            mp->in = pp->t;
+            return o_true;
+        }
+    }
+    return o_false;
+}
+
+static struct methods if_pattern_methods = PATTERN_METHODS(if_pattern_kind, if_pattern_match_x);
+
+KIND(if_pattern_kind)
+{
+    return methods_dispatch(&if_pattern_methods, self, args);
+}
+
+/*
+charset:
+    Character classes answer whether a character (an integer) is a member.
+
+    The members below 256 are held in a 256-bit bitmap, so testing them is a single bit test.
+    (Characters from a C string may be negative; they are tested by their byte value.)
+    Members above 255 are found by binary search in a sorted table of code-point ranges.
+    An 'exclset' is the complement of the class it is built from.
+
+    A class with at most 8 bytes in its bitmap (or excluded from it) also lists them as 'lane' bytes,
+    so 'charset_span' can compare a whole vector of input bytes to each of them at once.
+*/
+
+#if defined(__GNUC__)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+#define NO_SANITIZE_ADDRESS
+#endif
+
+static OOP
+charset_init(struct charset_p * this, char * set, const struct charset_range * range, int n_range)
+{
+    this->s = set;
+    memset(this->bits, 0, sizeof(this->bits));
+    while (*set) {
+        int c = (unsigned char)*set++;
+        this->bits[c >> 6] |= ((uint64_t)1 << (c & 0x3F));
+    }
+    int i;
+    for (i = 0; i < n_range; ++i) {  // ranges may cover some of the bitmap too
+        int c;
+        for (c = range[i].lo; (c <= range[i].hi) && (c < 256); ++c) {
+            this->bits[c >> 6] |= ((uint64_t)1 << (c & 0x3F));
+        }
+    }
+    this->range = range;
+    this->n_range = n_range;
+    this->n_lane = 0;
+    for (i = 1; i < 256; ++i) {  // NUL ends every span, so it is never a lane
+        if (charset_bit(this, i)) {
+            if (this->n_lane >= (int)sizeof(this->lane)) {
+                this->n_lane = -1;  // too many to compare in parallel
+                break;
+            }
+            this->lane[this->n_lane++] = i;
+        }
+    }
+    if (charset_bit(this, 0)) {
+        this->n_lane = -1;
+    }
+    return (OOP)this;
+}
+
+/*
+    Return non-zero if character 'c' is in the class 'cs' (ignoring whether it is an 'exclset').
+*/
+int
+charset_member(struct charset_p * cs, int c)
+{
+    if ((c >= -128) && (c < 256)) {
+        return charset_bit(cs, c);
+    }
+    int lo = 0;
+    int hi = cs->n_range - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        if (c < cs->range[mid].lo) {
+            hi = mid - 1;
+        } else if (c > cs->range[mid].hi) {
+            lo = mid + 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+    Return the number of bytes at the start of NUL-terminated 's' that are in class 'cs'
+    (or, if 'excl' is non-zero, that are not in it).
+
+    Vector loads are aligned, so they never cross into the next page, but they may read
+    the bytes following the NUL in the same vector (hence NO_SANITIZE_ADDRESS).
+*/
+NO_SANITIZE_ADDRESS size_t
+charset_span(struct charset_p * cs, int excl, char * s)
+{
+    char * p = s;
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+#define SPAN_WIDTH          (32)
+#define span_vector         __m256i
+#define span_load(p)        _mm256_load_si256((const __m256i *)(p))
+#define span_splat(c)       _mm256_set1_epi8(c)
+#define span_zero()         _mm256_setzero_si256()
+#define span_eq(a, b)       _mm256_cmpeq_epi8((a), (b))
+#define span_or(a, b)       _mm256_or_si256((a), (b))
+#define span_mask(v)        ((uint32_t)_mm256_movemask_epi8(v))
+#else
+#define SPAN_WIDTH          (16)
+#define span_vector         __m128i
+#define span_load(p)        _mm_load_si128((const __m128i *)(p))
+#define span_splat(c)       _mm_set1_epi8(c)
+#define span_zero()         _mm_setzero_si128()
+#define span_eq(a, b)       _mm_cmpeq_epi8((a), (b))
+#define span_or(a, b)       _mm_or_si128((a), (b))
+#define span_mask(v)        ((uint32_t)_mm_movemask_epi8(v))
+#endif
+    if (cs->n_lane >= 0) {
+        while (((uintptr_t)p & (SPAN_WIDTH - 1)) != 0) {  // reach an aligned vector
+            if ((*p == '\0') || ((int)charset_bit(cs, *p) == excl)) {
+                return (p - s);
+            }
+            ++p;
+        }
+        span_vector lane[sizeof(cs->lane)];
+        int i;
+        for (i = 0; i < cs->n_lane; ++i) {
+            lane[i] = span_splat(cs->lane[i]);
+        }
+        uint32_t all = (uint32_t)((((uint64_t)1) << SPAN_WIDTH) - 1);
+        for (;;) {
+            span_vector v = span_load(p);
+            span_vector hit = span_zero();
+            for (i = 0; i < cs->n_lane; ++i) {
+                hit = span_or(hit, span_eq(v, lane[i]));
+            }
+            uint32_t in = span_mask(hit);  // bytes in 'bits'
+            uint32_t end = span_mask(span_eq(v, span_zero()));
+            uint32_t stop = excl ? (in | end) : (~in & all);  // NUL is never in 'bits'
+            if (stop != 0) {
+                return (p - s) + __builtin_ctz(stop);
+            }
+            p += SPAN_WIDTH;
+        }
+    }
+#endif
+    while ((*p != '\0') && ((int)charset_bit(cs, *p) != excl)) {
+        ++p;
+    }
+    return (p - s);
+}
+
+OOP
+charset_p_new(char * set)
+{
+    return charset_p_range_new(set, NULL, 0);
+}
+
+OOP
+charset_p_range_new(char * set, const struct charset_range * range, int n_range)
+{
+    struct charset_p * this = object_alloc(struct charset_p, charset_p_kind);
+    return charset_init(this, set, range, n_range);
+}
+
+/*
+    Test a character (every integer is a fixnum) for membership, or (if 'excl' is non-zero) exclusion.
+*/
+static OOP
+charset_call(OOP self, OOP * args, int excl)
+{
+    struct charset_p * this = as_charset_p(self);
+    OOP cmd = take_arg();
+    if (is_fixnum(cmd)) {        // FIXME: IS THIS THE RIGHT PROTOCOL FOR PREDICATE FUNCTIONS?
+        return (charset_member(this, fixnum_value(cmd)) != excl) ? o_true : o_false;
+    }
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    }
+    return o_undef;
+}
+
+KIND(charset_p_kind)
+{
+    return charset_call(self, args, 0);
+}
+
+OOP
+exclset_p_new(char * excl)
+{
+    return exclset_p_range_new(excl, NULL, 0);
+}
+
+OOP
+exclset_p_range_new(char * excl, const struct charset_range * range, int n_range)
+{
+    struct charset_p * this = object_alloc(struct charset_p, exclset_p_kind);
+    return charset_init(this, excl, range, n_range);
+}
+
+KIND(exclset_p_kind)
+{
+    return charset_call(self, args, 1);
+}
+
+OOP
+or_pattern_new(OOP head, OOP tail)
+{
+    struct or_pattern * this = object_alloc(struct or_pattern, or_pattern_kind);
+    this->head = head;
+    this->tail = tail;
+    return (OOP)this;
+}
+/* LET or(left, right) = \in.(
+    CASE left(in) OF
+    (#ok, value, in') : (#ok, value, in')
+    (#fail, in') : right(in)
+    END
+) */
+static struct icache or_pattern_icache = ICACHE_INIT("or_pattern head");
+
+static KIND(or_pattern_match_x)
+{
+//    struct or_pattern * this = as_or_pattern(self);  -- moved inside loop...
+    TRACE(fprintf(stderr, "%p(or_pattern_kind)\n", self));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    do {
+        struct or_pattern * this = as_or_pattern(self);
+        TRACE(fprintf(stderr, "%p(or_pattern_kind, %p, %p)\n", this, this->head, this->tail));
+        if (o_true == icache_call1(&or_pattern_icache, this->head, s_match_x, match)) {
+            return o_true;  // success
+        }
+        self = this->tail;  // simulate tail-recursion (a failed 'head' left 'match' unchanged)
+    } while (or_pattern_kind == self->kind);
+    return object_call(self, s_match_x, match);
+}
+
+static struct methods or_pattern_methods = PATTERN_METHODS(or_pattern_kind, or_pattern_match_x);
+
+KIND(or_pattern_kind)
+{
+    return methods_dispatch(&or_pattern_methods, self, args);
+}
+
+OOP
+and_pattern_new(OOP head, OOP tail)
+{
+    struct and_pattern * this = object_alloc(struct and_pattern, and_pattern_kind);
+    this->head = head;
+    this->tail = tail;
+    return (OOP)this;
+}
+/* LET and(left, right) = \in.(
+    CASE left(in) OF
+    (#fail, in') : (#fail, in)
+    (#ok, value, in') : (
+        CASE right(in') OF
+        (#fail, in'') : (#fail, in)
+        (#ok, value', in'') : (#ok, (value, value'), in'')
+        END
+    )
+    END
+) */
+static struct icache and_pattern_head_icache = ICACHE_INIT("and_pattern head");
+static struct icache and_pattern_tail_icache = ICACHE_INIT("and_pattern tail");
+
+static KIND(and_pattern_match_x)
+{
+    struct and_pattern * this = as_and_pattern(self);
+    TRACE(fprintf(stderr, "%p(and_pattern_kind, %p, %p)\n", this, this->head, this->tail));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    OOP in = mp->in;  // restored if 'tail' fails
+    char * at = mp->at;
+    OOP env = mp->env;
+    OOP out = mp->out;
+    if (o_true == icache_call1(&and_pattern_head_icache, this->head, s_match_x, match)) {
+        OOP out1 = mp->out;
+        if (o_true == icache_call1(&and_pattern_tail_icache, this->tail, s_match_x, match)) {
+            mp->out = pair_new(out1, mp->out);
+            return o_true;
+        }
+        mp->in = in;
+        mp->at = at;
+        mp->env = env;
+        mp->out = out;
+    }
+    return o_false;
+}
+
+static struct methods and_pattern_methods = PATTERN_METHODS(and_pattern_kind, and_pattern_match_x);
+
+KIND(and_pattern_kind)
+{
+    return methods_dispatch(&and_pattern_methods, self, args);
+}
+
+OOP
+bind_pattern_new(OOP name, OOP ptrn)
+{
+    struct bind_pattern * this = object_alloc(struct bind_pattern, bind_pattern_kind);
+    this->name = name;
+    this->ptrn = ptrn;
+    return (OOP)this;
+}
+/* LET bind(name, ptrn) = \(value, env, in).(
+    CASE ptrn(value, env, in) OF
+    (#ok, value', env', in') : (#ok, value', env'.bind(name, value'), in')
+    (#fail, value', env', in') : (#fail, value, env, in)
+    END
+) */
+static KIND(bind_pattern_match_x)
+{
+    struct bind_pattern * this = as_bind_pattern(self);
+    TRACE(fprintf(stderr, "%p(bind_pattern_kind, %p, %p)\n", this, this->name, this->ptrn));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    if (o_true == object_call(this->ptrn, s_match_x, match)) {
+        mp->env = object_call(mp->env, s_bind, this->name, mp->out);
+        return o_true;
+    }
+    return o_false;
+}
+
+static struct methods bind_pattern_methods = PATTERN_METHODS(bind_pattern_kind, bind_pattern_match_x);
+
+KIND(bind_pattern_kind)
+{
+    return methods_dispatch(&bind_pattern_methods, self, args);
+}
+
+/*
+input = "2#1011.\n"
+digit = '0' | '1'
+digits = digit digits | digit
+grammar = any '#' digits
+*/
+
+/* LET alt(matches) = (
+    CASE matches OF
+    () : fail
+    (first, rest) : or(first, alt(rest))
+    last : last
+    END
+) */
+
+/* LET seq(matches) = (
+    CASE matches OF
+    () : empty
+    (first, rest) : and(first, seq(rest))
+    last : last
+    END
+) */
+
+/* LET opt(match) = or(match, empty) */
+OOP
+opt_pattern_new(OOP ptrn)
+{
+    return or_pattern_new(ptrn, ptrn_empty);
+}
+
+/* LET star(match) = \in.((opt(and(match, star(match))))(in)) */
+OOP
+star_pattern_new(OOP ptrn)
+{
+    struct ref_pattern * this = object_alloc(struct ref_pattern, star_pattern_kind);
+    this->ptrn = ptrn;
+    return (OOP)this;
+}
+static struct icache star_pattern_icache = ICACHE_INIT("star_pattern");
+
+static KIND(star_pattern_match_x)
+{
+    struct ref_pattern * this = as_ref_pattern(self);
+    TRACE(fprintf(stderr, "%p(star_pattern_kind, %p)\n", this, this->ptrn));
+    OOP match = take_arg();
+    if (if_pattern_kind == this->ptrn->kind) {  // a run of characters from a class?
+        OOP test = as_if_pattern(this->ptrn)->test;
+        if ((charset_p_kind == kind_of(test)) || (exclset_p_kind == kind_of(test))) {
+            struct match * mp = as_match(match);
+            char * at = match_cursor(mp);
+            if (at != NULL) {  // skip the run in the string
+                size_t n = charset_span(as_charset_p(test), (exclset_p_kind == kind_of(test)), at);
+                if (n > 0) {
+                    mp->out = integer_new(at[n - 1]);  // the last character, as if matched one at a time
+                    mp->at = at + n;
+                }
+                return o_true;
+            }
+            OOP run = object_call(mp->in, s_span, test);
+            if (pair_kind == kind_of(run)) {
+                mp->out = as_pair(run)->h;  // the last character, as if matched one at a time
+                mp->in = as_pair(run)->t;
+                return o_true;
+            }
+            if (o_nil == run) {
+                return o_true;  // no characters
+            }
+            // the stream can't span, so match one at a time
+        }
+    }
+    for(;;) {
+        struct match * mp = as_match(match);
+        TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+        if (o_true != icache_call1(&star_pattern_icache, this->ptrn, s_match_x, match)) {
+            return o_true;  // previous success (a failed 'ptrn' left 'match' unchanged)
+        }
+    }
+}
+
+static struct methods star_pattern_methods = PATTERN_METHODS(star_pattern_kind, star_pattern_match_x);
+
+KIND(star_pattern_kind)
+{
+    return methods_dispatch(&star_pattern_methods, self, args);
+}
+
+/* LET plus(match) = and(match, star(match)) */
+OOP
+plus_pattern_new(OOP ptrn)
+{
+    return and_pattern_new(ptrn, star_pattern_new(ptrn));
+}
+
+/*
+memo:
+    A memo table caches the result of matching a rule at an input position (packrat parsing).
+    Rules are memoized selectively, by wrapping them with 'memo_pattern_new'.
+    When every rule that may be re-tried at the same position is memoized,
+    and the table has room for each (rule, position) pair, matching takes linear time.
+
+    The table has a fixed number of entries (rounded up to a power of 2), so its footprint is bounded.
+    Each (rule, position, bindings) key has one place in the table, replacing any earlier entry.
+    An input position is identified by its stream object (see "string_stream" in "json.c").
+    Use 'memo_reset' before matching a new input, to release the results of the last one.
+
+    A memoized rule starts with an empty value (as if preceded by 'empty'),
+    so its result depends only on the input position and bindings.
+*/
+
+#define MEMO_ENTRY          (7)     // 'pattern', 'in', 'env', then 'ok', and the resulting 'in', 'env', 'out'
+#define memo_slot(table)    ((OOP *)((struct object *)(table) + 1))  // entries follow the header
+
+OOP
+memo_new(size_t size)
+{
+    struct memo * this = object_alloc(struct memo, memo_kind);
+    this->size = 1;
+    while (this->size < size) {  // entries are indexed by masking a hash
+        this->size <<= 1;
+    }
+    size = this->size;
+    this->table = (OOP)gc_alloc(sizeof(struct object) + size * MEMO_ENTRY * sizeof(OOP));
+    this->table->kind = object_kind;
+    this->hits = 0;
+    this->misses = 0;
+    return (OOP)this;
+}
+
+/*
+    Forget all memoized results, and start counting 'hits' and 'misses' again.
+*/
+void
+memo_reset(OOP memo)
+{
+    struct memo * this = as_memo(memo);
+    memset(memo_slot(this->table), 0, this->size * MEMO_ENTRY * sizeof(OOP));
+    this->hits = 0;
+    this->misses = 0;
+}
+
+static OOP *
+memo_entry(struct memo * this, OOP ptrn, OOP in, OOP env)
+{
+    uintptr_t h = ((uintptr_t)ptrn >> 3) * 31;
+    h = (h + ((uintptr_t)in >> 3)) * 31;
+    h = (h + ((uintptr_t)env >> 3)) * 2654435761u;
+    return memo_slot(this->table) + ((h >> 8) & (this->size - 1)) * MEMO_ENTRY;
+}
+
+/*
+    Look up the result of memoized rule 'ptrn' at 'in' with 'env'.
+    Return o_true (with the resulting state in 'result') or o_false for a remembered result,
+    or NULL if the result is not in the table.
+*/
+OOP
+memo_recall(OOP ptrn, OOP in, OOP env, struct match * result)
+{
+    struct memo * memo = as_memo(as_memo_pattern(ptrn)->memo);
+    OOP * entry = memo_entry(memo, ptrn, in, env);
+    if ((entry[0] == ptrn) && (entry[1] == in) && (entry[2] == env)) {
+        ++memo->hits;
+        TRACE(fprintf(stderr, "  %p: hit {ok:%p}\n", ptrn, entry[3]));
+        if (o_true == entry[3]) {
+            result->at = NULL;
+            result->in = entry[4];
+            result->env = entry[5];
+            result->out = entry[6];
+        }
+        return entry[3];
+    }
+    ++memo->misses;
+    return NULL;
+}
+
+/*
+    Remember the result 'ok' (and the state in 'result', if o_true) of memoized rule 'ptrn' at 'in' with 'env'.
+*/
+void
+memo_remember(OOP ptrn, OOP in, OOP env, OOP ok, struct match * result)
+{
+    struct memo * memo = as_memo(as_memo_pattern(ptrn)->memo);
+    OOP * entry = memo_entry(memo, ptrn, in, env);
+    gc_store(&entry[0], ptrn);  // the table may outlive an aborted event
+    gc_store(&entry[1], in);
+    gc_store(&entry[2], env);
+    gc_store(&entry[3], ok);
+    gc_store(&entry[4], (o_true == ok) ? result->in : NULL);
+    gc_store(&entry[5], (o_true == ok) ? result->env : NULL);
+    gc_store(&entry[6], (o_true == ok) ? result->out : NULL);
+}
+
+static struct methods memo_methods = {
+    memo_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+    }
+};
+
+KIND(memo_kind)
+{
+    return methods_dispatch(&memo_methods, self, args);
+}
+
+OOP
+memo_pattern_new(OOP ptrn, OOP memo)
+{
+    struct memo_pattern * this = object_alloc(struct memo_pattern, memo_pattern_kind);
+    this->ptrn = ptrn;
+    this->memo = memo;
+    return (OOP)this;
+}
+/* LET memo(ptrn) = \in.(
+    CASE lookup(ptrn, in) OF
+    (#ok, result) : result
+    _ : remember(ptrn, in, ptrn(in))
+    END
+) */
+static KIND(memo_pattern_match_x)
+{
+    struct memo_pattern * this = as_memo_pattern(self);
+    TRACE(fprintf(stderr, "%p(memo_pattern_kind, %p, %p)\n", this, this->ptrn, this->memo));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    OOP ok = memo_recall(self, match_in(mp), mp->env, mp);  // positions are keyed by stream
+    if (ok != NULL) {
+        return ok;
+    }
+    OOP in = mp->in;
+    OOP env = mp->env;
+    OOP out = mp->out;
+    mp->out = o_nil;  // start with an empty value
+    ok = object_call(this->ptrn, s_match_x, match);
+    if (o_true == ok) {
+        match_in(mp);
+    }
+    memo_remember(self, in, env, ok, mp);
+    if (o_true != ok) {
+        mp->out = out;  // leave the state as it was
+    }
+    return ok;
+}
+
+static struct methods memo_pattern_methods = PATTERN_METHODS(memo_pattern_kind, memo_pattern_match_x);
+
+KIND(memo_pattern_kind)
+{
+    return methods_dispatch(&memo_pattern_methods, self, args);
+}
+
+/* LET not(match) = \in.(
+    CASE match(in) OF
+    (#ok, value, in') : (#fail, in)
+    (#fail, in') : (#ok, (), in)
+    END
+) */
+
+/* LET peek(match) = not(not(match)) */
+
+/*
+expr:
+    Expressions represent procedures for computing a value.
+    
+    value := o.eval(env)        -- return result of evaluating this expression in environment 'env'
+*/
+
+struct symbol eval_symbol = { { symbol_kind }, "eval", SEL_EVAL };
+struct symbol combine_symbol = { { symbol_kind }, "combine", SEL_COMBINE };
+
+// "bottom" represents the inability to determine a result when evaluating an expression
+struct object bottom_object = { object_kind };
+
+KIND(const_expr_kind)
+{
+    TRACE(fprintf(stderr, "%p(const_expr_kind)\n", self));
+    OOP cmd = take_arg();
+    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    } else if (cmd == s_eval) {
+        OOP env = take_arg();  // constants evaluate to themselves
+        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
+        return self;
+    }
+    return o_undef;
+}
+
+OOP
+ident_expr_new(OOP name)
+{
+    struct ident_expr * this = object_alloc(struct ident_expr, ident_expr_kind);
+    this->name = name;
+    return (OOP)this;
+}
+KIND(ident_expr_kind)
+{
+    struct ident_expr * this = as_ident_expr(self);
+    TRACE(fprintf(stderr, "%p(ident_expr_kind, %p \"%s\")\n", this, this->name, as_symbol(this->name)->s));
+    OOP cmd = take_arg();
+    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    } else if (cmd == s_eval) {
+        OOP env = take_arg();
+        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
+        return object_call(env, s_lookup, this->name);
+    }
+    return o_undef;
+}
+
+OOP
+combine_expr_new(OOP oper, OOP opnd)
+{
+    struct combine_expr * this = object_alloc(struct combine_expr, combine_expr_kind);
+    this->oper = oper;
+    this->opnd = opnd;
+    return (OOP)this;
+}
+KIND(combine_expr_kind)
+{
+    struct combine_expr * this = as_combine_expr(self);
+    TRACE(fprintf(stderr, "%p(combine_expr_kind, %p, %p)\n", this, this->oper, this->opnd));
+    OOP cmd = take_arg();
+    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    } else if (cmd == s_eval) {
+        OOP env = take_arg();
+        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
+        OOP comb = object_call(this->oper, s_eval, env);  // evaluate oper (in env) to yield combiner
+        TRACE(fprintf(stderr, "  %p: combiner=%p\n", self, comb));
+        return object_call(comb, s_combine, this->opnd, env);  // send operand to combiner (with env)
+    }
+    return o_undef;
+}
+
+OOP
+appl_expr_new(OOP comb)
+{
+    struct appl_expr * this = object_alloc(struct appl_expr, appl_expr_kind);
+    this->comb = comb;
+    return (OOP)this;
+}
+KIND(appl_expr_kind)
+{
+    struct appl_expr * this = as_appl_expr(self);
+    TRACE(fprintf(stderr, "%p(appl_expr_kind, %p)\n", this, this->comb));
+    OOP cmd = take_arg();
+    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    } else if (cmd == s_eval) {
+        OOP env = take_arg();
+        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
+        return self;  // applicatives evaluate to themselves
+    } else if (cmd == s_combine) {
+        OOP opnd = take_arg();
+        OOP env = take_arg();
+        TRACE(fprintf(stderr, "  %p: combine {opnd:%p env:%p}\n", self, opnd, env));
+        OOP arg = object_call(opnd, s_eval, env);  // evaluate opnd (in env) to yield argument
+        TRACE(fprintf(stderr, "  %p: arg=%p\n", self, arg));
+        return object_call(this->comb, s_combine, arg, env);  // send arg to combiner (with env)
+    }
+    return o_undef;
+}
+
+OOP
+thunk_expr_new(OOP env, OOP ptrn, OOP expr)
+{
+    struct thunk_expr * this = object_alloc(struct thunk_expr, thunk_expr_kind);
+    this->env = env;
+    this->ptrn = ptrn;
+    this->expr = expr;
+    return (OOP)this;
+}
+KIND(thunk_expr_kind)
+{
+    struct thunk_expr * this = as_thunk_expr(self);
+    TRACE(fprintf(stderr, "%p(thunk_expr_kind, %p, %p, %p)\n", this, this->env, this->ptrn, this->expr));
+    OOP cmd = take_arg();
+    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    } else if (cmd == s_eval) {
+        OOP env = take_arg();
+        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
+        return self;  // closures evaluate to themselves
+    } else if (cmd == s_combine) {
+        OOP opnd = take_arg();
+        OOP denv = take_arg();        // dynamic environment (ignored)
+        TRACE(fprintf(stderr, "  %p: combine {opnd:%p denv:%p}\n", self, opnd, denv));
+        OOP match = match_new(opnd, this->env, o_undef);
+        match = object_call(this->ptrn, s_match, match);
+        if (match_kind == match->kind) {
+            struct match * mp = as_match(match);
+            TRACE(fprintf(stderr, "  %p: env'=%p\n", self, mp->env));
+            return object_call(this->expr, s_eval, mp->env);  // evaluate body in extended environment
+        }
+        return o_bottom;  // parameter pattern mismatch
+    }
+    return o_undef;
+}
+
+OOP
+lambda_expr_new(OOP ptrn, OOP expr)
+{
+    struct lambda_expr * this = object_alloc(struct lambda_expr, lambda_expr_kind);
+    this->ptrn = ptrn;
+    this->expr = expr;
+    return (OOP)this;
+}
+KIND(lambda_expr_kind)
+{
+    struct lambda_expr * this = as_lambda_expr(self);
+    TRACE(fprintf(stderr, "%p(lambda_expr_kind, %p, %p)\n", this, this->ptrn, this->expr));
+    OOP cmd = take_arg();
+    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    } else if (cmd == s_eval) {
+        OOP env = take_arg();
+        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
+        OOP oper = thunk_expr_new(env, this->ptrn, this->expr);
+        TRACE(fprintf(stderr, "  %p: oper=%p\n", self, oper));
+        return appl_expr_new(oper);
+    }
+    return o_undef;
+}
+
+OOP
+oper_expr_new(OOP env, OOP ptrn, OOP evar, OOP expr)
+{
+    struct oper_expr * this = object_alloc(struct oper_expr, oper_expr_kind);
+    this->env = env;
+    this->ptrn = ptrn;
+    this->evar = evar;
+    this->expr = expr;
+    return (OOP)this;
+}
+KIND(oper_expr_kind)
+{
+    struct oper_expr * this = as_oper_expr(self);
+    TRACE(fprintf(stderr, "%p(oper_expr_kind, %p, %p, %p, %p)\n", this, this->env, this->ptrn, this->evar, this->expr));
+    OOP cmd = take_arg();
+    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    } else if (cmd == s_eval) {
+        OOP env = take_arg();
+        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
+        return self;  // operatives evaluate to themselves
+    } else if (cmd == s_combine) {
+        OOP opnd = take_arg();
+        OOP denv = take_arg();        // dynamic environment
+        TRACE(fprintf(stderr, "  %p: combine {opnd:%p denv:%p}\n", self, opnd, denv));
+        OOP match = match_new(opnd, this->env, o_undef);
+        match = object_call(this->ptrn, s_match, match);
+        if (match_kind == match->kind) {
+            OOP env = as_match(match)->env;
+            TRACE(fprintf(stderr, "  %p: env'=%p\n", self, env));
+            if (symbol_kind == kind_of(this->evar)) {
+                env = object_call(env, s_bind, this->evar, denv);  // bind dynamic environment
+                TRACE(fprintf(stderr, "  %p: env''=%p\n", self, env));
+            }
+            return object_call(this->expr, s_eval, env);  // evaluate body in extended environment
+        }
+        return o_bottom;  // parameter pattern mismatch
+    }
+    return o_undef;
+}
+
+OOP
+quote_expr_new(OOP value)
+{
+    struct quote_expr * this = object_alloc(struct quote_expr, quote_expr_kind);
+    this->value = value;
+    return (OOP)this;
+}
+KIND(quote_expr_kind)
+{
+    struct quote_expr * this = as_quote_expr(self);
+    TRACE(fprintf(stderr, "%p(quote_expr_kind, %p)\n", this, this->value));
+    OOP cmd = take_arg();
+    TRACE(fprintf(stderr, "  %p: cmd=%p \"%s\"\n", self, cmd, as_symbol(cmd)->s));
+    if (cmd == s_eq_p) {
+        OOP other = take_arg();
+        if (other == self) {  // compare identities
+            return o_true;
+        }
+        return o_false;
+    } else if (cmd == s_eval) {
+        OOP env = take_arg();
+        TRACE(fprintf(stderr, "  %p: eval {env:%p}\n", self, env));
+        return this->value;
+    }
+    return o_undef;
+}
@@ -0,0 +1,573 @@
+/*
+
+pconfig.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stdio.h>  /* for TRACE */
+#include <sched.h>
+#include "pconfig.h"
+#include "pair.h"
+#include "gc.h"
+
+/*
+deque:
+    A work-stealing deque (Chase-Lev) of ready actors.
+    The owning worker pushes and pops at the bottom, other workers steal from the top.
+
+    The actors are held in a circular buffer, which doubles when full.
+    Each buffer is a heap object, retained while it is current, so ready actors survive collection.
+    A replaced buffer may still be read by a concurrent thief, but is not collected
+    before the next 'gc_collect', which never runs while workers are dispatching.
+*/
+
+#define DEQUE_INIT_SIZE     (64)
+
+struct deque_ring {
+    struct object       o;
+    long                size;       // capacity (a power of 2)
+    _Atomic(OOP)        slot[];
+};
+#define as_deque_ring(oop) ((struct deque_ring *)(oop))
+
+static OOP
+deque_ring_new(long size)
+{
+    struct deque_ring * ring = (struct deque_ring *)gc_alloc(sizeof(struct deque_ring) + size * sizeof(OOP));
+    ring->o.kind = object_kind;
+    ring->size = size;
+    gc_retain((OOP)ring);
+    return (OOP)ring;
+}
+
+static void
+deque_init(struct deque * d)
+{
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    atomic_init(&d->ring, deque_ring_new(DEQUE_INIT_SIZE));
+}
+
+static struct deque_ring *
+deque_grow(struct deque * d, struct deque_ring * ring, long t, long b)
+{
+    struct deque_ring * bigger = as_deque_ring(deque_ring_new(ring->size << 1));
+    long i;
+    for (i = t; i < b; ++i) {
+        OOP item = atomic_load_explicit(&ring->slot[i & (ring->size - 1)], memory_order_relaxed);
+        atomic_store_explicit(&bigger->slot[i & (bigger->size - 1)], item, memory_order_relaxed);
+    }
+    atomic_store_explicit(&d->ring, (OOP)bigger, memory_order_release);
+    gc_release((OOP)ring);
+    return bigger;
+}
+
+static void
+deque_push(struct deque * d, OOP item)  // owner only
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    struct deque_ring * ring = as_deque_ring(atomic_load_explicit(&d->ring, memory_order_relaxed));
+    if ((b - t) > (ring->size - 1)) {  // full
+        ring = deque_grow(d, ring, t, b);
+    }
+    atomic_store_explicit(&ring->slot[b & (ring->size - 1)], item, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+}
+
+static OOP
+deque_pop(struct deque * d)  // owner only
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    struct deque_ring * ring = as_deque_ring(atomic_load_explicit(&d->ring, memory_order_relaxed));
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    OOP item = NULL;
+    if (t <= b) {
+        item = atomic_load_explicit(&ring->slot[b & (ring->size - 1)], memory_order_relaxed);
+        if (t == b) {  // last event, race against thieves
+            if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                    memory_order_seq_cst, memory_order_relaxed)) {
+                item = NULL;  // stolen
+            }
+            atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {  // empty
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+static OOP
+deque_steal(struct deque * d)
+{
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t < b) {
+        struct deque_ring * ring = as_deque_ring(atomic_load_explicit(&d->ring, memory_order_acquire));
+        OOP item = atomic_load_explicit(&ring->slot[t & (ring->size - 1)], memory_order_relaxed);
+        if (atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                memory_order_seq_cst, memory_order_relaxed)) {
+            return item;
+        }
+    }
+    return NULL;  // empty, or lost a race
+}
+
+/*
+pconfig:
+    Parallel configurations deliver message-events on a pool of worker threads.
+    They answer the same protocol as 'config'.
+
+    remain := o.dispatch!(count)-- dispatch up to 'count' events, return how many 'remain'
+    remain := o.give!(event)    -- add 'event' to the queue of in-flight events
+    remain := o.give_all!(list) -- add each event in 'list' (or an effect buffer) to the queue of in-flight events
+
+    Each actor has a lock-free mailbox.  Any thread may push an event onto its 'inbox' stack
+    with compare-and-swap.  The worker running the actor takes the whole 'inbox' at once,
+    and reverses it into the 'mailbox' list, restoring the order of arrival.
+
+    Only actors with mail are scheduled.  Whoever sets an actor's 'scheduled' flag makes it ready,
+    by pushing it onto the deque of the current worker (or the shared queue, from outside).
+    A worker pops its own deque first, then takes actors made ready from outside,
+    then steals from the other workers.  Since a scheduled actor is on at most one deque
+    or worker, each actor still processes one message at a time.
+    A worker delivers up to PCONFIG_BATCH events per turn, then makes the actor ready again if it has mail.
+    By default, a worker favors the actors it made ready most recently, for locality,
+    so an actor that keeps sending to itself can starve the others.
+
+    If 'quota' is set, scheduling is fair.  Each turn delivers at most 'quota' events,
+    and each worker serves its ready actors round-robin: actors made ready from outside first,
+    then its own oldest first.  An actor with mail then waits for at most one turn
+    of each actor ahead of it.
+
+    If 'deterministic' is set, only the first worker delivers events.  It serves ready actors
+    round-robin, and never steals at random, so the same events always produce the same schedule
+    (e.g.: for reproducible benchmarks).
+
+    Set 'quota' and 'deterministic' only while no 'dispatch!' is in progress.
+
+    'dispatch!' lends the workers a budget of 'count' events.  It returns when the budget is spent,
+    or no events remain, and every worker is parked again.  Between calls to 'dispatch!'
+    the heap may be collected, and undelivered events stay queued for the next call.
+
+    As in 'config', the objects allocated by each event are freed as soon as it aborts,
+    and the events of a suspended sponsor are held (see "sponsor" in "actor.c").
+
+    NOTE: Parallel configurations are retained as garbage-collection roots until 'pconfig_stop'.
+          They do not allocate effects from an arena.
+*/
+
+#define PCONFIG_BATCH       (8)     // events delivered per actor turn
+
+static void
+pconfig_progress(struct pconfig * this)
+{
+    if ((atomic_load(&this->remain) <= 0) || (atomic_load(&this->budget) <= 0)) {
+        pthread_mutex_lock(&this->lock);
+        pthread_cond_broadcast(&this->done);  // wake 'dispatch!'
+        pthread_mutex_unlock(&this->lock);
+    }
+}
+
+static int
+pconfig_charge(struct pconfig * this)
+{
+    long budget = atomic_load(&this->budget);
+    while (budget > 0) {
+        if (atomic_compare_exchange_weak(&this->budget, &budget, budget - 1)) {
+            return 1;
+        }
+    }
+    return 0;  // budget spent
+}
+
+/*
+    Push 'evt' onto the inbox of its target actor, returning non-zero if the caller must make the actor ready.
+*/
+static int
+mailbox_put(OOP evt)
+{
+    struct event * ep = as_event(evt);
+    struct actor * ap = as_actor(ep->actor);
+    OOP head = atomic_load(&ap->inbox);
+    do {
+        ep->next = head;
+    } while (!atomic_compare_exchange_weak(&ap->inbox, &head, evt));
+    return (atomic_exchange(&ap->scheduled, 1) == 0);
+}
+
+/*
+    Remove the oldest event from the mailbox of a scheduled actor, or return NULL if there is none.
+*/
+static OOP
+mailbox_take(struct actor * ap)
+{
+    OOP evt = ap->mailbox;
+    if (evt == NULL) {
+        OOP stack = atomic_exchange(&ap->inbox, NULL);
+        while (stack != NULL) {  // reverse into arrival order
+            OOP next = as_event(stack)->next;
+            as_event(stack)->next = evt;
+            evt = stack;
+            stack = next;
+        }
+        if (evt == NULL) {
+            return NULL;
+        }
+    }
+    ap->mailbox = as_event(evt)->next;
+    as_event(evt)->next = NULL;
+    return evt;
+}
+
+static void
+pconfig_ready(struct pconfig * this, OOP actor)
+{
+    pthread_mutex_lock(&this->lock);
+    object_call(this->actors, s_give_x, actor);
+    atomic_fetch_add(&this->ready, 1);
+    pthread_mutex_unlock(&this->lock);
+}
+
+static OOP
+pconfig_take(struct pconfig * this)
+{
+    OOP actor = NULL;
+    if (atomic_load(&this->ready) > 0) {
+        pthread_mutex_lock(&this->lock);
+        if (object_call(this->actors, s_empty_p) == o_false) {
+            actor = object_call(this->actors, s_take_x);
+            atomic_fetch_sub(&this->ready, 1);
+        }
+        pthread_mutex_unlock(&this->lock);
+    }
+    return actor;
+}
+
+static OOP
+worker_next(struct worker * w)
+{
+    struct pconfig * this = w->config;
+    OOP actor;
+    if (this->deterministic || (this->quota > 0)) {  // round-robin
+        actor = pconfig_take(this);
+        if (actor == NULL) {
+            actor = deque_steal(&w->deque);  // oldest first
+        }
+    } else {
+        actor = deque_pop(&w->deque);  // newest first
+        if (actor == NULL) {
+            actor = pconfig_take(this);
+        }
+    }
+    int i;
+    for (i = 0; (actor == NULL) && (i < this->n_workers); ++i) {
+        struct worker * victim = this->deterministic
+            ? &this->workers[i]  // fixed order
+            : &this->workers[rand_r(&w->seed) % this->n_workers];
+        if (victim != w) {
+            actor = deque_steal(&victim->deque);
+        }
+    }
+    return actor;
+}
+
+static void
+worker_dispatch(struct worker * w, OOP evt)
+{
+    struct pconfig * this = w->config;
+    struct event * ep = as_event(evt);
+    TRACE(fprintf(stderr, "  %p: worker=%p event=%p\n", this, w, evt));
+    struct sponsor * sp = (o_nil != ep->sponsor) ? as_sponsor(ep->sponsor) : NULL;
+    if ((sp != NULL) && atomic_load(&sp->suspended)) {
+        TRACE(fprintf(stderr, "  %p: event=%p ---HELD---\n", this, evt));
+        sponsor_hold(sp, evt);  // hold until refilled
+        atomic_fetch_sub(&this->remain, 1);
+        return;
+    }
+    struct gc_txn txn;
+    gc_begin(&txn);
+    OOP result = object_call(evt, s_dispatch_x);
+    TRACE(fprintf(stderr, "  %p: result=%p\n", this, result));
+    event_flush(evt);  // every message is delivered through a mailbox
+    int exhausted = 0;
+    if (sp != NULL) {  // check budgets
+        if ((o_true == result) && !sponsor_charge(sp, txn.count, txn.bytes)) {
+            result = o_false;
+            exhausted = 1;
+        }
+        if (o_true != result) {
+            sponsor_refund(sp, evt);
+        }
+    }
+    if (o_true == result) {
+        gc_commit(&txn);
+        if (o_nil != ep->events) {  // deliver events, in the order sent
+            struct effects * fp = as_effects(ep->events);
+            long i;
+            atomic_fetch_add(&this->remain, fp->count);
+            for (i = 0; i < fp->count; ++i) {
+                if (mailbox_put(fp->event[i])) {
+                    deque_push(&w->deque, as_event(fp->event[i])->actor);
+                }
+            }
+        }
+        as_actor(ep->actor)->beh = ep->beh;  // replace behavior
+        event_perform(evt);
+    } else {
+        TRACE(fprintf(stderr, "  %p: event=%p ---ABORTED---\n", this, evt));
+        gc_abort(&txn);  // release aborted effects
+        ep->actors = o_nil;  // forget released effects
+        ep->events = o_nil;
+        ep->output = o_nil;
+        ep->beh = as_actor(ep->actor)->beh;
+        if (exhausted) {
+            sponsor_hold(sp, evt);  // retry when refilled
+        }
+    }
+    atomic_fetch_sub(&this->remain, 1);
+}
+
+/*
+    Deliver a batch of events to a scheduled 'actor', leaving it ready (if it has mail) or unscheduled.
+*/
+static void
+worker_turn(struct worker * w, OOP actor)
+{
+    struct pconfig * this = w->config;
+    struct actor * ap = as_actor(actor);
+    int quota = (this->quota > 0) ? this->quota : PCONFIG_BATCH;
+    int n;
+    for (n = 0; n < quota; ++n) {
+        OOP evt = mailbox_take(ap);
+        if (evt == NULL) {
+            atomic_store(&ap->scheduled, 0);
+            if ((atomic_load(&ap->inbox) != NULL)  // mail arrived while unscheduling
+            &&  (atomic_exchange(&ap->scheduled, 1) == 0)) {
+                deque_push(&w->deque, actor);
+            }
+            return;
+        }
+        if (!pconfig_charge(this)) {
+            as_event(evt)->next = ap->mailbox;  // put it back
+            ap->mailbox = evt;
+            break;
+        }
+        worker_dispatch(w, evt);
+    }
+    deque_push(&w->deque, actor);  // still ready
+}
+
+static void
+worker_run(struct worker * w)
+{
+    struct pconfig * this = w->config;
+    while (atomic_load(&this->running)) {
+        OOP actor = worker_next(w);
+        if (actor == NULL) {
+            pconfig_progress(this);
+            sched_yield();
+            continue;
+        }
+        worker_turn(w, actor);
+        if (atomic_load(&this->budget) <= 0) {
+            sched_yield();  // wait for 'dispatch!' to stop us
+        }
+        pconfig_progress(this);
+    }
+}
+
+static void *
+worker_main(void * arg)
+{
+    struct worker * w = (struct worker *)arg;
+    struct pconfig * this = w->config;
+    long generation = 0;
+    pthread_mutex_lock(&this->lock);
+    for (;;) {
+        while ((this->generation == generation) && !this->shutdown) {
+            pthread_cond_wait(&this->start, &this->lock);
+        }
+        if (this->shutdown) {
+            break;
+        }
+        generation = this->generation;
+        --this->parked;
+        pthread_mutex_unlock(&this->lock);
+        if (!this->deterministic || (w == this->workers)) {
+            worker_run(w);
+        }
+        pthread_mutex_lock(&this->lock);
+        ++this->parked;
+        pthread_cond_broadcast(&this->done);
+    }
+    pthread_mutex_unlock(&this->lock);
+    return NULL;
+}
+
+OOP
+pconfig_new(int n_workers)
+{
+    struct pconfig * this = object_alloc(struct pconfig, pconfig_kind);
+    this->actors = queue_new();
+    atomic_init(&this->ready, 0);
+    atomic_init(&this->remain, 0);
+    atomic_init(&this->budget, 0);
+    atomic_init(&this->running, 0);
+    pthread_mutex_init(&this->lock, NULL);
+    pthread_cond_init(&this->start, NULL);
+    pthread_cond_init(&this->done, NULL);
+    this->generation = 0;
+    this->parked = n_workers;
+    this->shutdown = 0;
+    this->deterministic = 0;
+    this->quota = 0;
+    gc_retain((OOP)this);
+    this->n_workers = n_workers;
+    this->workers = (struct worker *)ALLOC(n_workers * sizeof(struct worker));
+    int i;
+    for (i = 0; i < n_workers; ++i) {
+        struct worker * w = &this->workers[i];
+        w->config = this;
+        w->seed = (unsigned int)i + 1;
+        deque_init(&w->deque);
+    }
+    for (i = 0; i < n_workers; ++i) {
+        struct worker * w = &this->workers[i];
+        pthread_create(&w->thread, NULL, worker_main, w);
+    }
+    return (OOP)this;
+}
+
+/*
+    Stop and join the workers of a parallel configuration, and release it for collection.
+*/
+void
+pconfig_stop(OOP config)
+{
+    struct pconfig * this = as_pconfig(config);
+    pthread_mutex_lock(&this->lock);
+    this->shutdown = 1;
+    pthread_cond_broadcast(&this->start);
+    pthread_mutex_unlock(&this->lock);
+    int i;
+    for (i = 0; i < this->n_workers; ++i) {
+        struct worker * w = &this->workers[i];
+        pthread_join(w->thread, NULL);
+        gc_release(atomic_load(&w->deque.ring));
+    }
+    FREE(this->workers);
+    this->workers = NULL;
+    this->n_workers = 0;
+    pthread_cond_destroy(&this->done);
+    pthread_cond_destroy(&this->start);
+    pthread_mutex_destroy(&this->lock);
+    gc_release(config);
+}
+
+static KIND(pconfig_give_x)
+{
+    struct pconfig * this = as_pconfig(self);
+    OOP evt = take_arg();
+    TRACE(fprintf(stderr, "%p pconfig_kind {remain:%ld}\n", this, atomic_load(&this->remain)));
+    TRACE(fprintf(stderr, "  %p: give! {event:%p}\n", this, evt));
+    atomic_fetch_add(&this->remain, 1);
+    if (mailbox_put(evt)) {
+        pconfig_ready(this, as_event(evt)->actor);
+    }
+    return integer_new((int)atomic_load(&this->remain));
+}
+
+static KIND(pconfig_give_all_x)
+{
+    struct pconfig * this = as_pconfig(self);
+    OOP list = take_arg();
+    TRACE(fprintf(stderr, "%p pconfig_kind {remain:%ld}\n", this, atomic_load(&this->remain)));
+    TRACE(fprintf(stderr, "  %p: give_all! {events:%p}\n", this, list));
+    if (effects_kind == kind_of(list)) {
+        struct effects * fp = as_effects(list);
+        long i;
+        atomic_fetch_add(&this->remain, fp->count);
+        for (i = 0; i < fp->count; ++i) {
+            if (mailbox_put(fp->event[i])) {
+                pconfig_ready(this, as_event(fp->event[i])->actor);
+            }
+        }
+        return integer_new((int)atomic_load(&this->remain));
+    }
+    long n = 0;
+    OOP events;
+    for (events = list; o_nil != events; events = as_pair(events)->t) {
+        ++n;
+    }
+    atomic_fetch_add(&this->remain, n);
+    for (events = list; o_nil != events; events = as_pair(events)->t) {
+        OOP evt = as_pair(events)->h;
+        if (mailbox_put(evt)) {
+            pconfig_ready(this, as_event(evt)->actor);
+        }
+    }
+    return integer_new((int)atomic_load(&this->remain));
+}
+
+static KIND(pconfig_dispatch_x)
+{
+    struct pconfig * this = as_pconfig(self);
+    OOP count = take_arg();
+    TRACE(fprintf(stderr, "%p pconfig_kind {remain:%ld}\n", this, atomic_load(&this->remain)));
+    TRACE(fprintf(stderr, "  %p: dispatch {count:%d}\n", this, integer_value(count)));
+    pthread_mutex_lock(&this->lock);
+    atomic_store(&this->budget, integer_value(count));
+    atomic_store(&this->running, 1);
+    ++this->generation;
+    pthread_cond_broadcast(&this->start);
+    while ((atomic_load(&this->remain) > 0) && (atomic_load(&this->budget) > 0)) {
+        pthread_cond_wait(&this->done, &this->lock);
+    }
+    atomic_store(&this->running, 0);
+    while (this->parked < this->n_workers) {  // wait for events in progress
+        pthread_cond_wait(&this->done, &this->lock);
+    }
+    pthread_mutex_unlock(&this->lock);
+    TRACE(fprintf(stderr, "  %p: remain=%ld\n", this, atomic_load(&this->remain)));
+    return integer_new((int)atomic_load(&this->remain));
+}
+
+static struct methods pconfig_methods = {
+    pconfig_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_GIVE_X] = pconfig_give_x,
+        [SEL_GIVE_ALL_X] = pconfig_give_all_x,
+        [SEL_DISPATCH_X] = pconfig_dispatch_x,
+    }
+};
+
+KIND(pconfig_kind)
+{
+    return methods_dispatch(&pconfig_methods, self, args);
+}
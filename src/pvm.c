@@ -0,0 +1,549 @@
+/*
+
+pvm.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#include <stdio.h>  /* for TRACE */
+#include <string.h>
+#include "pvm.h"
+#include "pair.h"
+#include "json.h"
+
+/*
+pvm:
+    A pattern graph may be compiled into a program for a backtracking virtual machine (after LPEG).
+    The compiled pattern matches exactly like the graph it came from, with the same results,
+    but keeps its state (in, env, out) in local variables, and its backtrack entries on a stack.
+    Only the values a match produces (pairs, and bindings) are allocated.
+
+    Named rules (and memoized rules) are compiled once, and called, so recursive grammars work.
+    Each 'named_pattern' is resolved when the pattern is compiled. A name not bound by then
+    is matched through its 'match!' method, so it is looked up each time it is matched.
+    Patterns of other kinds are called through their 'match!' method.
+
+    A memoized rule uses the same memo table (and the same entries) as the pattern graph.
+    A remembered result is taken without calling the rule. Otherwise the result is remembered
+    when the rule returns, or (by a backtrack entry) when it fails.
+
+        or(head, tail)  ->      CHOICE L1
+                                <head>
+                                COMMIT L2
+                            L1: <tail>
+                            L2:
+
+        and(head, tail) ->      <head>
+                                PUSH
+                                <tail>
+                                PAIR
+
+        star(ptrn)      ->  L1: CHOICE L2
+                                <ptrn>
+                                PARTIAL_COMMIT L1
+                            L2:
+
+        star(if(charset)) ->    SPAN charset
+
+        memo(ptrn)      ->      MEMO L1
+                                EMPTY
+                                CALL <ptrn>
+                                MEMO_COMMIT L2
+                            L1: MEMO_FAIL
+                            L2:
+
+    A failure resumes at the most recent backtrack entry, restoring the state it saved
+    (and discarding any return entries above it). If there is none, the match fails.
+*/
+
+#define PVM_INIT_SIZE       (64)
+#define PVM_INIT_RULES      (8)
+
+struct pvm_compiler {
+    struct pvm_instr *  code;
+    int                 count;
+    int                 limit;
+    OOP *               rule;       // patterns compiled as rules
+    int *               addr;       // start of each rule (or -1 if not yet compiled)
+    int                 n_rules;
+    int                 rules_limit;
+};
+
+static int
+pvm_emit(struct pvm_compiler * c, int op, int arg, OOP value)
+{
+    if (c->count >= c->limit) {
+        int limit = c->limit << 1;
+        struct pvm_instr * code = (struct pvm_instr *)ALLOC(limit * sizeof(struct pvm_instr));
+        memcpy(code, c->code, c->count * sizeof(struct pvm_instr));
+        FREE(c->code);
+        c->code = code;
+        c->limit = limit;
+    }
+    struct pvm_instr * ip = &c->code[c->count];
+    ip->op = op;
+    ip->arg = arg;
+    ip->value = value;
+    return c->count++;
+}
+
+/*
+    Return the index of the rule for 'ptrn', adding it if it is new.
+*/
+static int
+pvm_rule(struct pvm_compiler * c, OOP ptrn)
+{
+    int i;
+    for (i = 0; i < c->n_rules; ++i) {
+        if (c->rule[i] == ptrn) {
+            return i;
+        }
+    }
+    if (c->n_rules >= c->rules_limit) {
+        int limit = c->rules_limit << 1;
+        OOP * rule = (OOP *)ALLOC(limit * sizeof(OOP));
+        int * addr = (int *)ALLOC(limit * sizeof(int));
+        memcpy(rule, c->rule, c->n_rules * sizeof(OOP));
+        memcpy(addr, c->addr, c->n_rules * sizeof(int));
+        FREE(c->rule);
+        FREE(c->addr);
+        c->rule = rule;
+        c->addr = addr;
+        c->rules_limit = limit;
+    }
+    c->rule[c->n_rules] = ptrn;
+    c->addr[c->n_rules] = -1;
+    return c->n_rules++;
+}
+
+static void
+pvm_compile_node(struct pvm_compiler * c, OOP ptrn)
+{
+    if (ptrn == ptrn_fail) {
+        pvm_emit(c, PVM_FAIL, 0, NULL);
+    } else if (ptrn == ptrn_empty) {
+        pvm_emit(c, PVM_EMPTY, 0, NULL);
+    } else if (ptrn == ptrn_all) {
+        pvm_emit(c, PVM_ALL, 0, NULL);
+    } else if (ptrn == ptrn_end) {
+        pvm_emit(c, PVM_END, 0, NULL);
+    } else if (ptrn == ptrn_any) {
+        pvm_emit(c, PVM_ANY, 0, NULL);
+    } else if (eq_pattern_kind == ptrn->kind) {
+        pvm_emit(c, PVM_EQ, 0, as_eq_pattern(ptrn)->value);
+    } else if (if_pattern_kind == ptrn->kind) {
+        OOP test = as_if_pattern(ptrn)->test;
+        if (charset_p_kind == kind_of(test)) {
+            pvm_emit(c, PVM_SET, 0, test);
+        } else if (exclset_p_kind == kind_of(test)) {
+            pvm_emit(c, PVM_SET, 1, test);
+        } else {
+            pvm_emit(c, PVM_IF, 0, test);
+        }
+    } else if (or_pattern_kind == ptrn->kind) {
+        int choice = pvm_emit(c, PVM_CHOICE, 0, NULL);
+        pvm_compile_node(c, as_or_pattern(ptrn)->head);
+        int commit = pvm_emit(c, PVM_COMMIT, 0, NULL);
+        c->code[choice].arg = c->count;
+        pvm_compile_node(c, as_or_pattern(ptrn)->tail);
+        c->code[commit].arg = c->count;
+    } else if (and_pattern_kind == ptrn->kind) {
+        pvm_compile_node(c, as_and_pattern(ptrn)->head);
+        pvm_emit(c, PVM_PUSH, 0, NULL);
+        pvm_compile_node(c, as_and_pattern(ptrn)->tail);
+        pvm_emit(c, PVM_PAIR, 0, NULL);
+    } else if (bind_pattern_kind == ptrn->kind) {
+        pvm_compile_node(c, as_bind_pattern(ptrn)->ptrn);
+        pvm_emit(c, PVM_BIND, 0, as_bind_pattern(ptrn)->name);
+    } else if ((star_pattern_kind == ptrn->kind)
+           &&  (if_pattern_kind == as_ref_pattern(ptrn)->ptrn->kind)
+           &&  ((charset_p_kind == kind_of(as_if_pattern(as_ref_pattern(ptrn)->ptrn)->test))
+             || (exclset_p_kind == kind_of(as_if_pattern(as_ref_pattern(ptrn)->ptrn)->test)))) {
+        OOP test = as_if_pattern(as_ref_pattern(ptrn)->ptrn)->test;
+        pvm_emit(c, PVM_SPAN, (exclset_p_kind == kind_of(test)), test);
+    } else if (star_pattern_kind == ptrn->kind) {
+        int choice = pvm_emit(c, PVM_CHOICE, 0, NULL);
+        pvm_compile_node(c, as_ref_pattern(ptrn)->ptrn);
+        pvm_emit(c, PVM_PARTIAL_COMMIT, choice, NULL);
+        c->code[choice].arg = c->count;
+    } else if (memo_pattern_kind == ptrn->kind) {
+        int memo = pvm_emit(c, PVM_MEMO, 0, ptrn);
+        pvm_emit(c, PVM_EMPTY, 0, NULL);  // memoized rules start with an empty value
+        pvm_emit(c, PVM_CALL, pvm_rule(c, as_memo_pattern(ptrn)->ptrn), NULL);
+        int commit = pvm_emit(c, PVM_MEMO_COMMIT, 0, ptrn);
+        c->code[memo].arg = pvm_emit(c, PVM_MEMO_FAIL, 0, ptrn);
+        c->code[commit].arg = c->count;
+    } else if (named_pattern_kind == ptrn->kind) {
+        struct named_pattern * np = as_named_pattern(ptrn);
+        OOP rule = object_call(np->scope, s_lookup, np->name);
+        if (o_fail == rule) {
+            pvm_emit(c, PVM_MATCH, 0, ptrn);  // not bound yet, look it up when matching
+        } else {
+            pvm_emit(c, PVM_CALL, pvm_rule(c, rule), NULL);
+        }
+    } else {
+        pvm_emit(c, PVM_MATCH, 0, ptrn);
+    }
+}
+
+/*
+    Compile the pattern graph 'ptrn' into an equivalent pattern, run by the pattern virtual machine.
+*/
+OOP
+pattern_compile(OOP ptrn)
+{
+    struct pvm_compiler c;
+    c.limit = PVM_INIT_SIZE;
+    c.count = 0;
+    c.code = (struct pvm_instr *)ALLOC(c.limit * sizeof(struct pvm_instr));
+    c.rules_limit = PVM_INIT_RULES;
+    c.n_rules = 0;
+    c.rule = (OOP *)ALLOC(c.rules_limit * sizeof(OOP));
+    c.addr = (int *)ALLOC(c.rules_limit * sizeof(int));
+    pvm_compile_node(&c, ptrn);
+    pvm_emit(&c, PVM_HALT, 0, NULL);
+    int i;
+    for (i = 0; i < c.n_rules; ++i) {  // rules may add more rules
+        c.addr[i] = c.count;
+        pvm_compile_node(&c, c.rule[i]);
+        pvm_emit(&c, PVM_RETURN, 0, NULL);
+    }
+    for (i = 0; i < c.count; ++i) {
+        if (c.code[i].op == PVM_CALL) {
+            c.code[i].arg = c.addr[c.code[i].arg];
+        }
+    }
+    struct pvm_pattern * this = (struct pvm_pattern *)object_new(pvm_pattern_kind,
+        sizeof(struct pvm_pattern) + c.count * sizeof(struct pvm_instr));
+    this->count = c.count;
+    memcpy(this->code, c.code, c.count * sizeof(struct pvm_instr));
+    TRACE(fprintf(stderr, "%p pattern_compile {ptrn:%p, count:%d, rules:%d}\n", this, ptrn, c.count, c.n_rules));
+    FREE(c.addr);
+    FREE(c.rule);
+    FREE(c.code);
+    return (OOP)this;
+}
+
+/*
+    Take the next token from 'in', returning its (token, rest) pair, or NULL at the end of the input.
+*/
+static struct pair *
+pvm_pop(OOP in)
+{
+    if (string_stream_kind == in->kind) {  // never empty
+        OOP next = as_string_stream(in)->next;
+        return as_pair((next != NULL) ? next : object_call(in, s_pop));
+    }
+    if (object_call(in, s_empty_p) == o_false) {
+        return as_pair(object_call(in, s_pop));
+    }
+    return NULL;
+}
+
+/*
+    Backtrack entries save the state to restore, return entries only 'pc' (with 'in' set to NULL).
+*/
+struct pvm_frame {
+    int             pc;         // where to resume
+    long            vtop;       // height of the value stack
+    OOP             in;
+    OOP             env;
+    OOP             out;
+};
+
+#define PVM_STACK           (64)
+
+struct pvm_stacks {
+    struct pvm_frame *  frame;
+    long                top;
+    long                limit;
+    OOP *               value;
+    long                vtop;
+    long                vlimit;
+    struct pvm_frame    frame0[PVM_STACK];
+    OOP                 value0[PVM_STACK];
+};
+
+static struct pvm_frame *
+pvm_push_frame(struct pvm_stacks * s)
+{
+    if (s->top >= s->limit) {
+        long limit = s->limit << 1;
+        struct pvm_frame * frame = (struct pvm_frame *)ALLOC(limit * sizeof(struct pvm_frame));
+        memcpy(frame, s->frame, s->top * sizeof(struct pvm_frame));
+        if (s->frame != s->frame0) {
+            FREE(s->frame);
+        }
+        s->frame = frame;
+        s->limit = limit;
+    }
+    return &s->frame[s->top++];
+}
+
+static void
+pvm_push_value(struct pvm_stacks * s, OOP value)
+{
+    if (s->vtop >= s->vlimit) {
+        long limit = s->vlimit << 1;
+        OOP * stack = (OOP *)ALLOC(limit * sizeof(OOP));
+        memcpy(stack, s->value, s->vtop * sizeof(OOP));
+        if (s->value != s->value0) {
+            FREE(s->value);
+        }
+        s->value = stack;
+        s->vlimit = limit;
+    }
+    s->value[s->vtop++] = value;
+}
+
+static OOP
+pvm_run(struct pvm_pattern * this, struct match * state)
+{
+    OOP in = state->in;
+    OOP env = state->env;
+    OOP out = state->out;
+    struct pvm_stacks s;
+    s.frame = s.frame0;
+    s.top = 0;
+    s.limit = PVM_STACK;
+    s.value = s.value0;
+    s.vtop = 0;
+    s.vlimit = PVM_STACK;
+    OOP result = o_false;
+    struct pair * pp;
+    int pc = 0;
+    for (;;) {
+        struct pvm_instr * ip = &this->code[pc++];
+        switch (ip->op) {
+        case PVM_EMPTY:
+            out = o_nil;
+            continue;
+        case PVM_ALL:
+            out = in;
+            continue;
+        case PVM_END:
+            if (object_call(in, s_empty_p) == o_true) {
+                out = o_nil;
+                continue;
+            }
+            break;  // fail
+        case PVM_ANY:
+            if ((pp = pvm_pop(in)) != NULL) {
+                out = pp->h;
+                in = pp->t;
+                continue;
+            }
+            break;  // fail
+        case PVM_EQ:
+            if ((pp = pvm_pop(in)) != NULL) {
+                if ((ip->value == pp->h)  // identical tokens (such as fixnums) are equal
+                ||  (object_call(ip->value, s_eq_p, pp->h) == o_true)) {
+                    out = pp->h;
+                    in = pp->t;
+                    continue;
+                }
+            }
+            break;  // fail
+        case PVM_IF:
+            if ((pp = pvm_pop(in)) != NULL) {
+                if (object_call(ip->value, pp->h) == o_true) {
+                    out = pp->h;
+                    in = pp->t;
+                    continue;
+                }
+            }
+            break;  // fail
+        case PVM_SET:
+            if ((pp = pvm_pop(in)) != NULL) {
+                if (is_fixnum(pp->h)
+                    ? (charset_member(as_charset_p(ip->value), fixnum_value(pp->h)) != ip->arg)
+                    : (object_call(ip->value, pp->h) == o_true)) {
+                    out = pp->h;
+                    in = pp->t;
+                    continue;
+                }
+            }
+            break;  // fail
+        case PVM_SPAN: {
+            OOP run = object_call(in, s_span, ip->value);
+            if (pair_kind == kind_of(run)) {  // the stream skipped the run itself
+                out = as_pair(run)->h;
+                in = as_pair(run)->t;
+                continue;
+            }
+            if (o_undef == run) {  // match one at a time
+                while ((pp = pvm_pop(in)) != NULL) {
+                    if (is_fixnum(pp->h)
+                        ? (charset_member(as_charset_p(ip->value), fixnum_value(pp->h)) == ip->arg)
+                        : (object_call(ip->value, pp->h) != o_true)) {
+                        break;
+                    }
+                    out = pp->h;
+                    in = pp->t;
+                }
+            }
+            continue;
+        }
+        case PVM_BIND:
+            env = object_call(env, s_bind, ip->value, out);
+            continue;
+        case PVM_PUSH:
+            pvm_push_value(&s, out);
+            continue;
+        case PVM_PAIR:
+            out = pair_new(s.value[--s.vtop], out);
+            continue;
+        case PVM_CHOICE: {
+            struct pvm_frame * fp = pvm_push_frame(&s);
+            fp->pc = ip->arg;
+            fp->vtop = s.vtop;
+            fp->in = in;
+            fp->env = env;
+            fp->out = out;
+            continue;
+        }
+        case PVM_COMMIT:
+            --s.top;
+            pc = ip->arg;
+            continue;
+        case PVM_PARTIAL_COMMIT: {
+            struct pvm_frame * fp = &s.frame[s.top - 1];
+            fp->vtop = s.vtop;
+            fp->in = in;
+            fp->env = env;
+            fp->out = out;
+            pc = ip->arg + 1;  // skip the CHOICE
+            continue;
+        }
+        case PVM_CALL: {
+            struct pvm_frame * fp = pvm_push_frame(&s);
+            fp->pc = pc;
+            fp->in = NULL;  // return entry
+            pc = ip->arg;
+            continue;
+        }
+        case PVM_RETURN:
+            pc = s.frame[--s.top].pc;
+            continue;
+        case PVM_MEMO: {
+            struct match match;
+            OOP ok = memo_recall(ip->value, in, env, &match);
+            if (o_true == ok) {
+                in = match.in;
+                env = match.env;
+                out = match.out;
+                pc = ip->arg + 1;  // skip the MEMO_FAIL
+                continue;
+            }
+            if (o_false == ok) {
+                break;  // fail
+            }
+            struct pvm_frame * fp = pvm_push_frame(&s);
+            fp->pc = ip->arg;
+            fp->vtop = s.vtop;
+            fp->in = in;
+            fp->env = env;
+            fp->out = out;
+            continue;
+        }
+        case PVM_MEMO_COMMIT: {
+            struct pvm_frame * fp = &s.frame[--s.top];
+            struct match match;
+            match.in = in;
+            match.env = env;
+            match.out = out;
+            memo_remember(ip->value, fp->in, fp->env, o_true, &match);
+            pc = ip->arg;
+            continue;
+        }
+        case PVM_MEMO_FAIL:
+            memo_remember(ip->value, in, env, o_false, NULL);
+            break;  // fail
+        case PVM_MATCH: {
+            struct match match = *state;
+            match.in = in;
+            match.at = NULL;
+            match.env = env;
+            match.out = out;
+            if (object_call(ip->value, s_match_x, (OOP)&match) == o_true) {
+                in = match_in(&match);
+                env = match.env;
+                out = match.out;
+                continue;
+            }
+            break;  // fail
+        }
+        case PVM_HALT:
+            state->in = in;
+            state->env = env;
+            state->out = out;
+            result = o_true;
+            goto done;
+        }
+        // fail: resume at the most recent backtrack entry
+        while ((s.top > 0) && (s.frame[s.top - 1].in == NULL)) {
+            --s.top;  // discard return entries
+        }
+        if (s.top == 0) {
+            goto done;
+        }
+        struct pvm_frame * fp = &s.frame[--s.top];
+        pc = fp->pc;
+        s.vtop = fp->vtop;
+        in = fp->in;
+        env = fp->env;
+        out = fp->out;
+    }
+done:
+    if (s.frame != s.frame0) {
+        FREE(s.frame);
+    }
+    if (s.value != s.value0) {
+        FREE(s.value);
+    }
+    return result;
+}
+
+static KIND(pvm_pattern_match_x)
+{
+    struct pvm_pattern * this = as_pvm_pattern(self);
+    TRACE(fprintf(stderr, "%p(pvm_pattern_kind, %d)\n", this, this->count));
+    OOP match = take_arg();
+    struct match * mp = as_match(match);
+    TRACE(fprintf(stderr, "  %p: match {in:%p env:%p out:%p}\n", self, mp->in, mp->env, mp->out));
+    match_in(mp);  // the machine keeps its own position
+    return pvm_run(this, mp);
+}
+
+static struct methods pvm_pattern_methods = {
+    pvm_pattern_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_MATCH] = pattern_match,
+        [SEL_MATCH_X] = pvm_pattern_match_x,
+    }
+};
+
+KIND(pvm_pattern_kind)
+{
+    return methods_dispatch(&pvm_pattern_methods, self, args);
+}
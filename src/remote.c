@@ -0,0 +1,536 @@
+/*
+
+remote.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#include <stdio.h>  /* for TRACE */
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "remote.h"
+#include "pair.h"
+#include "pattern.h"
+#include "gc.h"
+
+/*
+remote:
+    Actors in other processes (on the same host) are reached through a connected Unix-domain socket.
+    A 'link' is the sending end, and a 'receiver' is the receiving end, of one such connection.
+
+    A proxy actor stands in for an actor exported by the remote 'receiver'.
+    Its behavior encodes each message it receives into a frame, held in the 'output' of the event.
+    Only when the event commits is the frame appended to the batch buffer of its 'link',
+    so an aborted (or held) event writes nothing.
+    A batch is written with a single 'send', when it exceeds LINK_BATCH bytes, or by 'link_flush'.
+    Messages that can't be encoded (such as actors) abort the event.
+
+    A failed write is remembered by the link.  The batch is dropped, 'link_flush' and 'link_close'
+    report the failure from then on, and messages to its proxies abort.
+
+    The 'receiver' reads a whole batch into its buffer, and decodes each frame in place,
+    giving an event for the exported actor to its configuration. Symbols are interned
+    straight from the buffer, so only names not seen before are copied.
+    Selectors are statically allocated, not interned, so they are sent by their 'sel' id instead,
+    and decode to the very same symbol (which still dispatches as a selector).
+
+    batch   = length:u32 frame*         -- 'length' is the number of bytes of frames
+    frame   = id:u32 value              -- 'id' is the index of an exported actor
+    value   = 'n'                       -- nil
+            | 't' | 'f'                 -- true, false
+            | 'i' n:i32                 -- integer
+            | 's' length:u32 char*      -- symbol
+            | 'x' sel:u8                -- selector symbol
+            | 'p' value value           -- pair (head, tail)
+
+    Both ends run on the same host, so numbers are written in the native byte order.
+
+    NOTE: Links and receivers are retained as garbage-collection roots until they are closed.
+*/
+
+#define LINK_BATCH          (4096)  // bytes buffered before a batch is written
+#define REMOTE_INIT_SIZE    (2 * LINK_BATCH)
+#define REMOTE_INIT_EXPORTS (16)
+#define exports_slot(table) ((OOP *)((struct object *)(table) + 1))  // actors follow the header
+
+static OOP remote_selector[SEL_MAX] = {  // selector symbols, by 'sel' id
+    [SEL_EQ_P] = s_eq_p,
+    [SEL_EMPTY_P] = s_empty_p,
+    [SEL_PUSH] = s_push,
+    [SEL_POP] = s_pop,
+    [SEL_PUT] = s_put,
+    [SEL_PULL] = s_pull,
+    [SEL_GIVE_X] = s_give_x,
+    [SEL_TAKE_X] = s_take_x,
+    [SEL_BIND] = s_bind,
+    [SEL_LOOKUP] = s_lookup,
+    [SEL_ADD] = s_add,
+    [SEL_MATCH] = s_match,
+    [SEL_EVAL] = s_eval,
+    [SEL_COMBINE] = s_combine,
+    [SEL_CREATE_X] = s_create_x,
+    [SEL_SEND_X] = s_send_x,
+    [SEL_BECOME_X] = s_become_x,
+    [SEL_DISPATCH_X] = s_dispatch_x,
+    [SEL_GIVE_ALL_X] = s_give_all_x,
+    [SEL_MATCH_X] = s_match_x,
+    [SEL_SPAN] = s_span,
+};
+
+static int
+write_full(int fd, char * p, size_t n)
+{
+    while (n > 0) {
+        ssize_t r = send(fd, p, n, MSG_NOSIGNAL);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += r;
+        n -= r;
+    }
+    return 0;
+}
+
+static int
+read_full(int fd, char * p, size_t n)
+{
+    while (n > 0) {
+        ssize_t r = recv(fd, p, n, 0);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (r == 0) {
+            return -1;  // connection closed part way through a batch
+        }
+        p += r;
+        n -= r;
+    }
+    return 0;
+}
+
+OOP
+link_new(int fd)
+{
+    struct link * this = object_alloc(struct link, link_kind);
+    this->fd = fd;
+    this->size = REMOTE_INIT_SIZE;
+    this->buf = (char *)ALLOC(this->size);
+    this->used = sizeof(uint32_t);  // room for the batch header
+    pthread_mutex_init(&this->lock, NULL);
+    atomic_init(&this->error, 0);
+    gc_retain((OOP)this);
+    return (OOP)this;
+}
+
+static void
+link_put(struct link * this, void * data, size_t n)
+{
+    if ((this->used + n) > this->size) {
+        size_t size = this->size;
+        while ((this->used + n) > size) {
+            size <<= 1;
+        }
+        char * buf = (char *)ALLOC(size);
+        memcpy(buf, this->buf, this->used);
+        FREE(this->buf);
+        this->buf = buf;
+        this->size = size;
+    }
+    memcpy(this->buf + this->used, data, n);
+    this->used += n;
+}
+
+/*
+    Return the number of bytes needed to encode 'value', or zero if it can't be sent.
+*/
+static size_t
+frame_size(OOP value)
+{
+    size_t n = 0;
+    for (;;) {
+        if ((o_nil == value) || (o_true == value) || (o_false == value)) {
+            n += 1;
+        } else if (integer_kind == kind_of(value)) {
+            n += 1 + sizeof(int32_t);
+        } else if (selector_of(value) != SEL_NONE) {
+            n += 1 + sizeof(uint8_t);
+        } else if (symbol_kind == kind_of(value)) {
+            n += 1 + sizeof(uint32_t) + strlen(as_symbol(value)->s);
+        } else if (pair_kind == kind_of(value)) {
+            size_t head = frame_size(as_pair(value)->h);
+            if (head == 0) {
+                return 0;
+            }
+            n += 1 + head;
+            value = as_pair(value)->t;  // iterate over lists
+            continue;
+        } else {
+            return 0;
+        }
+        return n;
+    }
+}
+
+/*
+    Write the encoding of 'value' (which can be sent) at 'p', returning the end of the encoding.
+*/
+static char *
+frame_encode(char * p, OOP value)
+{
+    for (;;) {
+        if (o_nil == value) {
+            *p++ = 'n';
+        } else if (o_true == value) {
+            *p++ = 't';
+        } else if (o_false == value) {
+            *p++ = 'f';
+        } else if (integer_kind == kind_of(value)) {
+            int32_t n = integer_value(value);
+            *p++ = 'i';
+            memcpy(p, &n, sizeof(n));
+            p += sizeof(n);
+        } else if (selector_of(value) != SEL_NONE) {
+            *p++ = 'x';
+            *p++ = (uint8_t)selector_of(value);
+        } else if (symbol_kind == kind_of(value)) {
+            char * s = as_symbol(value)->s;
+            uint32_t n = strlen(s);
+            *p++ = 's';
+            memcpy(p, &n, sizeof(n));
+            p += sizeof(n);
+            memcpy(p, s, n);
+            p += n;
+        } else {  // pair
+            *p++ = 'p';
+            p = frame_encode(p, as_pair(value)->h);
+            value = as_pair(value)->t;  // iterate over lists
+            continue;
+        }
+        return p;
+    }
+}
+
+/*
+    Write the frames buffered so far as one batch, returning -1 on failure (now, or by an earlier write).
+*/
+int
+link_flush(OOP link)
+{
+    struct link * this = as_link(link);
+    pthread_mutex_lock(&this->lock);
+    if ((this->used > sizeof(uint32_t)) && (0 == atomic_load(&this->error))) {
+        uint32_t length = this->used - sizeof(uint32_t);
+        memcpy(this->buf, &length, sizeof(length));
+        TRACE(fprintf(stderr, "%p link_flush {fd:%d, length:%lu}\n", this, this->fd, (unsigned long)length));
+        if (write_full(this->fd, this->buf, this->used) < 0) {
+            TRACE(fprintf(stderr, "  %p: errno=%d ---FAILED---\n", this, errno));
+            atomic_store(&this->error, errno);
+        }
+    }
+    this->used = sizeof(uint32_t);
+    pthread_mutex_unlock(&this->lock);
+    return (0 == atomic_load(&this->error)) ? 0 : -1;
+}
+
+/*
+    Write any buffered frames, close the connection, and release the link for collection.
+    Return -1 if any write failed.
+*/
+int
+link_close(OOP link)
+{
+    struct link * this = as_link(link);
+    int rv = link_flush(link);
+    close(this->fd);
+    this->fd = -1;
+    FREE(this->buf);
+    pthread_mutex_destroy(&this->lock);
+    gc_release(link);
+    return rv;
+}
+
+/*
+frame:
+    An encoded message for a 'link', output by a proxy and appended to the batch when its event commits.
+*/
+
+struct frame {
+    struct object       o;
+    OOP                 link;       // connection to write to
+    size_t              size;       // bytes in 'data'
+    char                data[];     // id:u32 value
+};
+#define as_frame(oop) ((struct frame *)(oop))
+static KIND(frame_kind);
+
+static KIND(frame_dispatch_x)
+{
+    struct frame * this = as_frame(self);
+    struct link * link = as_link(this->link);
+    TRACE(fprintf(stderr, "%p frame_kind {link:%p, size:%lu}\n", this, link, (unsigned long)this->size));
+    pthread_mutex_lock(&link->lock);
+    link_put(link, this->data, this->size);
+    int full = (link->used >= LINK_BATCH);
+    pthread_mutex_unlock(&link->lock);
+    if (full && (link_flush(this->link) < 0)) {
+        return o_false;
+    }
+    return o_true;
+}
+
+static struct methods frame_methods = {
+    frame_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_DISPATCH_X] = frame_dispatch_x,
+    }
+};
+
+static KIND(frame_kind)
+{
+    return methods_dispatch(&frame_methods, self, args);
+}
+
+static struct methods link_methods = {
+    link_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+    }
+};
+
+KIND(link_kind)
+{
+    return methods_dispatch(&link_methods, self, args);
+}
+
+OOP
+proxy_beh_new(OOP link, int id)
+{
+    struct proxy_beh * this = object_alloc(struct proxy_beh, proxy_beh_kind);
+    this->link = link;
+    this->id = id;
+    return (OOP)this;
+}
+
+KIND(proxy_beh_kind)
+{
+    struct proxy_beh * this = as_proxy_beh(self);
+    TRACE(fprintf(stderr, "%p proxy_beh_kind {link:%p, id:%d}\n", this, this->link, this->id));
+    OOP evt = take_arg();
+    OOP msg = as_event(evt)->msg;
+    if (0 != atomic_load(&as_link(this->link)->error)) {
+        TRACE(fprintf(stderr, "  %p: link=%p has failed\n", this, this->link));
+        return o_false;  // abort
+    }
+    size_t n = frame_size(msg);
+    if (n == 0) {
+        TRACE(fprintf(stderr, "  %p: msg=%p can't be sent\n", this, msg));
+        return o_false;  // abort
+    }
+    n += sizeof(uint32_t);
+    struct frame * fp = (struct frame *)object_new(frame_kind, sizeof(struct frame) + n);
+    fp->link = this->link;
+    fp->size = n;
+    uint32_t id = this->id;
+    memcpy(fp->data, &id, sizeof(id));
+    frame_encode(fp->data + sizeof(id), msg);
+    as_event(evt)->output = effects_add(as_event(evt)->output, (OOP)fp);  // written on commit
+    return o_true;  // commit
+}
+
+OOP
+receiver_new(int fd, OOP config)
+{
+    struct receiver * this = object_alloc(struct receiver, receiver_kind);
+    this->fd = fd;
+    this->config = config;
+    this->limit = REMOTE_INIT_EXPORTS;
+    this->exports = (OOP)gc_alloc(sizeof(struct object) + this->limit * sizeof(OOP));
+    this->exports->kind = object_kind;
+    this->n_exports = 0;
+    this->size = REMOTE_INIT_SIZE;
+    this->buf = (char *)ALLOC(this->size);
+    gc_retain((OOP)this);
+    return (OOP)this;
+}
+
+/*
+    Make 'actor' reachable from the remote process, returning the id its proxies must use.
+*/
+int
+receiver_export(OOP receiver, OOP actor)
+{
+    struct receiver * this = as_receiver(receiver);
+    if (this->n_exports >= this->limit) {
+        int limit = this->limit << 1;
+        OOP exports = (OOP)gc_alloc(sizeof(struct object) + limit * sizeof(OOP));
+        exports->kind = object_kind;
+        memcpy(exports_slot(exports), exports_slot(this->exports), this->n_exports * sizeof(OOP));
+        this->exports = exports;
+        this->limit = limit;
+    }
+    exports_slot(this->exports)[this->n_exports] = actor;
+    return this->n_exports++;
+}
+
+/*
+    Decode a value from the buffer at '*pp', or return NULL if it is malformed.
+*/
+static OOP
+receiver_decode(char ** pp, char * end)
+{
+    OOP value = NULL;
+    OOP * hole = &value;  // where the decoded value belongs
+    for (;;) {
+        if (*pp >= end) {
+            return NULL;
+        }
+        char tag = *(*pp)++;
+        if (tag == 'n') {
+            *hole = o_nil;
+        } else if (tag == 't') {
+            *hole = o_true;
+        } else if (tag == 'f') {
+            *hole = o_false;
+        } else if ((tag == 'i') && ((end - *pp) >= (long)sizeof(int32_t))) {
+            int32_t n;
+            memcpy(&n, *pp, sizeof(n));
+            *pp += sizeof(n);
+            *hole = integer_new(n);
+        } else if ((tag == 's') && ((end - *pp) >= (long)sizeof(uint32_t))) {
+            uint32_t n;
+            memcpy(&n, *pp, sizeof(n));
+            *pp += sizeof(n);
+            if ((end - *pp) < (long)n) {
+                return NULL;
+            }
+            *hole = symbol_new_n(*pp, n);
+            *pp += n;
+        } else if ((tag == 'x') && (*pp < end)) {
+            uint8_t sel = *(*pp)++;
+            if ((sel >= SEL_MAX) || (remote_selector[sel] == NULL)) {
+                return NULL;
+            }
+            *hole = remote_selector[sel];
+        } else if (tag == 'p') {
+            OOP head = receiver_decode(pp, end);
+            if (head == NULL) {
+                return NULL;
+            }
+            OOP pair = pair_new(head, o_nil);
+            *hole = pair;
+            hole = &as_pair(pair)->t;  // decode the tail next
+            continue;
+        } else {
+            return NULL;
+        }
+        return value;
+    }
+}
+
+/*
+    Give the events of every batch already received to the configuration, without waiting.
+    Return the number of events given, or -1 if the connection failed or a batch was malformed.
+*/
+int
+receiver_poll(OOP receiver)
+{
+    struct receiver * this = as_receiver(receiver);
+    int n = 0;
+    for (;;) {
+        uint32_t length;
+        ssize_t r = recv(this->fd, &length, sizeof(length), MSG_DONTWAIT);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? n : -1;
+        }
+        if (r == 0) {
+            return n;  // connection closed
+        }
+        if ((r < (ssize_t)sizeof(length))
+        &&  (read_full(this->fd, (char *)&length + r, sizeof(length) - r) < 0)) {
+            return -1;
+        }
+        if (length > this->size) {
+            FREE(this->buf);
+            while (length > this->size) {
+                this->size <<= 1;
+            }
+            this->buf = (char *)ALLOC(this->size);
+        }
+        if (read_full(this->fd, this->buf, length) < 0) {
+            return -1;
+        }
+        TRACE(fprintf(stderr, "%p receiver_poll {fd:%d, length:%lu}\n", this, this->fd, (unsigned long)length));
+        char * p = this->buf;
+        char * end = this->buf + length;
+        while (p < end) {
+            uint32_t id;
+            if ((end - p) < (long)sizeof(id)) {
+                return -1;
+            }
+            memcpy(&id, p, sizeof(id));
+            p += sizeof(id);
+            OOP msg = receiver_decode(&p, end);
+            if ((msg == NULL) || (id >= (uint32_t)this->n_exports)) {
+                return -1;
+            }
+            OOP actor = exports_slot(this->exports)[id];
+            object_call(this->config, s_give_x, event_new(actor, msg));
+            ++n;
+        }
+    }
+}
+
+static struct methods receiver_methods = {
+    receiver_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+    }
+};
+
+KIND(receiver_kind)
+{
+    return methods_dispatch(&receiver_methods, self, args);
+}
+
+/*
+    Close the connection, and release the receiver for collection.
+*/
+void
+receiver_close(OOP receiver)
+{
+    struct receiver * this = as_receiver(receiver);
+    close(this->fd);
+    this->fd = -1;
+    FREE(this->buf);
+    gc_release(receiver);
+}
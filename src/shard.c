@@ -0,0 +1,456 @@
+/*
+
+shard.c -- Actor Run-Time
+
+"MIT License"
+
+Copyright (c) 2013 Dale Schumacher, Tristan Slominski
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+#define _GNU_SOURCE  /* for pthread_setaffinity_np */
+#include <stdio.h>  /* for TRACE */
+#include <sched.h>
+#include <unistd.h>
+#include "shard.h"
+#include "pair.h"
+#include "gc.h"
+
+/*
+spsc:
+    A bounded queue of events, from one shard to another.
+    Only the sending shard puts, and only the receiving shard takes.
+
+    The events are held in a circular buffer, a heap object retained for the life of the queue.
+    Events that do not fit wait in 'overflow', in the order sent, until the receiver makes room.
+*/
+
+#define SPSC_SIZE           (256)
+#define spsc_slot(ring)     ((OOP *)((struct object *)(ring) + 1))  // events follow the header
+
+static void
+spsc_init(struct spsc * q)
+{
+    struct object * ring = (struct object *)gc_alloc(sizeof(struct object) + SPSC_SIZE * sizeof(OOP));
+    ring->kind = object_kind;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->ring = (OOP)ring;
+    q->size = SPSC_SIZE;
+    q->overflow = queue_new();
+    gc_retain(q->ring);
+    gc_retain(q->overflow);
+}
+
+static void
+spsc_release(struct spsc * q)
+{
+    gc_release(q->overflow);
+    gc_release(q->ring);
+}
+
+static int
+spsc_room(struct spsc * q)
+{
+    long tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    long head = atomic_load_explicit(&q->head, memory_order_acquire);
+    return ((tail - head) < q->size);
+}
+
+static void
+spsc_put(struct spsc * q, OOP evt)
+{
+    long tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    spsc_slot(q->ring)[tail & (q->size - 1)] = evt;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+static OOP
+spsc_take(struct spsc * q)
+{
+    long head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    long tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == tail) {
+        return NULL;
+    }
+    OOP evt = spsc_slot(q->ring)[head & (q->size - 1)];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return evt;
+}
+
+/*
+    Move waiting events from 'overflow' into the buffer, while there is room.
+*/
+static void
+spsc_flush(struct spsc * q)
+{
+    while ((object_call(q->overflow, s_empty_p) == o_false) && spsc_room(q)) {
+        spsc_put(q, object_call(q->overflow, s_take_x));
+    }
+}
+
+/*
+shards:
+    A sharded configuration is a set of sequential configurations, each dispatched by its own thread,
+    pinned to its own core (where supported). Every actor is owned by one shard (see 'shards_config'),
+    and its events are only ever dispatched there, so shards share no actors, queues, or locks.
+
+    remain := o.dispatch!(count)-- dispatch up to 'count' events, on all shards, return how many 'remain'
+    remain := o.give!(event)    -- give 'event' to the shard owning its actor
+    remain := o.give_all!(list) -- give each event in 'list' to the shard owning its actor
+
+    Each configuration has a 'router', which moves the events it sends to actors owned by other shards
+    into a queue from the sending shard to the owning one. Events sent from one shard to another
+    arrive in the order sent. Actors with no owner (such as the 'a_sink') are dispatched by the first shard,
+    so no actor is ever dispatched by two shards at once.
+
+    Shards claim the 'budget' of a 'dispatch!' a batch at a time, and give back what they do not use.
+    Events are only given from outside while the shards are stopped, between calls to 'dispatch!'.
+
+    NOTE: Sharded configurations are retained as garbage-collection roots until 'shards_stop'.
+*/
+
+#define SHARDS_BATCH        (32)    // events claimed from the budget at a time
+
+struct route {
+    struct object       o;
+    struct shards *     group;      // sharded configuration
+    int                 from;       // index of the shard using this router
+};
+#define as_route(oop) ((struct route *)(oop))
+
+static KIND(route_kind);
+
+static int
+shards_index(struct shards * this, OOP config)
+{
+    if (config == NULL) {
+        return 0;  // unowned actors are dispatched by the first shard
+    }
+    OOP router = as_config(config)->router;
+    if (o_nil == router) {
+        return 0;  // actors owned by a plain configuration, too
+    }
+    struct route * r = as_route(router);
+    if ((r->group != this) || (r->from < 0) || (r->from >= this->n_shards)) {
+        return 0;  // and those owned by another group
+    }
+    return r->from;
+}
+
+static void
+shards_progress(struct shards * this)
+{
+    if ((atomic_load(&this->remain) <= 0)
+    ||  ((atomic_load(&this->budget) <= 0) && (atomic_load(&this->claimed) <= 0))) {
+        pthread_mutex_lock(&this->lock);
+        pthread_cond_broadcast(&this->done);  // wake 'dispatch!'
+        pthread_mutex_unlock(&this->lock);
+    }
+}
+
+static long
+shards_claim(struct shards * this)
+{
+    atomic_fetch_add(&this->claimed, SHARDS_BATCH);
+    long budget = atomic_load(&this->budget);
+    long n;
+    do {
+        n = (budget < SHARDS_BATCH) ? budget : SHARDS_BATCH;
+        if (n <= 0) {
+            n = 0;
+            break;
+        }
+    } while (!atomic_compare_exchange_weak(&this->budget, &budget, budget - n));
+    atomic_fetch_sub(&this->claimed, SHARDS_BATCH - n);
+    return n;
+}
+
+static void
+shards_unclaim(struct shards * this, long claim, long used)
+{
+    atomic_fetch_add(&this->budget, claim - used);  // give back before releasing the claim
+    atomic_fetch_sub(&this->claimed, claim);
+}
+
+static void
+shard_run(struct shard * s)
+{
+    struct shards * this = s->group;
+    struct config * cfg = as_config(s->config);
+    int n = this->n_shards;
+    while (atomic_load(&this->running)) {
+        int i;
+        for (i = 0; i < n; ++i) {
+            if (i != s->index) {
+                struct spsc * in = &this->queue[i * n + s->index];
+                OOP evt;
+                while ((evt = spsc_take(in)) != NULL) {  // receive events sent by other shards
+                    object_call(s->config, s_give_x, evt);
+                }
+                spsc_flush(&this->queue[s->index * n + i]);
+            }
+        }
+        long claim = 0;
+        if (cfg->remain > 0) {
+            claim = shards_claim(this);
+        }
+        if (claim == 0) {
+            shards_progress(this);
+            sched_yield();
+            continue;
+        }
+        long remain = cfg->remain;
+        long dispatched = cfg->dispatched;
+        object_call(s->config, s_dispatch_x, integer_new(claim));
+        atomic_fetch_add(&this->remain, cfg->remain - remain);  // events sent elsewhere were counted by the router
+        shards_unclaim(this, claim, cfg->dispatched - dispatched);
+        shards_progress(this);
+    }
+}
+
+static void *
+shard_main(void * arg)
+{
+    struct shard * s = (struct shard *)arg;
+    struct shards * this = s->group;
+    long generation = 0;
+    pthread_mutex_lock(&this->lock);
+    for (;;) {
+        while ((this->generation == generation) && !this->shutdown) {
+            pthread_cond_wait(&this->start, &this->lock);
+        }
+        if (this->shutdown) {
+            break;
+        }
+        generation = this->generation;
+        --this->parked;
+        pthread_mutex_unlock(&this->lock);
+        shard_run(s);
+        pthread_mutex_lock(&this->lock);
+        ++this->parked;
+        pthread_cond_broadcast(&this->done);
+    }
+    pthread_mutex_unlock(&this->lock);
+    return NULL;
+}
+
+static void
+shard_pin(struct shard * s)
+{
+#ifdef __linux__
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus > 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(s->index % n_cpus, &cpus);
+        pthread_setaffinity_np(s->thread, sizeof(cpus), &cpus);  // best effort
+    }
+#endif
+}
+
+OOP
+shards_new(int n_shards)
+{
+    struct shards * this = object_alloc(struct shards, shards_kind);
+    atomic_init(&this->remain, 0);
+    atomic_init(&this->budget, 0);
+    atomic_init(&this->claimed, 0);
+    atomic_init(&this->running, 0);
+    pthread_mutex_init(&this->lock, NULL);
+    pthread_cond_init(&this->start, NULL);
+    pthread_cond_init(&this->done, NULL);
+    this->generation = 0;
+    this->parked = n_shards;
+    this->shutdown = 0;
+    gc_retain((OOP)this);
+    this->n_shards = n_shards;
+    this->shard = (struct shard *)ALLOC(n_shards * sizeof(struct shard));
+    this->queue = (struct spsc *)ALLOC(n_shards * n_shards * sizeof(struct spsc));
+    int i;
+    for (i = 0; i < (n_shards * n_shards); ++i) {
+        spsc_init(&this->queue[i]);
+    }
+    for (i = 0; i < n_shards; ++i) {
+        struct shard * s = &this->shard[i];
+        s->group = this;
+        s->index = i;
+        s->config = config_new();
+        struct route * r = object_alloc(struct route, route_kind);
+        r->group = this;
+        r->from = i;
+        as_config(s->config)->router = (OOP)r;
+    }
+    for (i = 0; i < n_shards; ++i) {
+        struct shard * s = &this->shard[i];
+        pthread_create(&s->thread, NULL, shard_main, s);
+        shard_pin(s);
+    }
+    return (OOP)this;
+}
+
+/*
+    Return the configuration of shard 'index', which owns the actors whose 'config' refers to it.
+*/
+OOP
+shards_config(OOP shards, int index)
+{
+    struct shards * this = as_shards(shards);
+    return this->shard[index].config;
+}
+
+/*
+    Stop and join the shards of a sharded configuration, and release it for collection.
+*/
+void
+shards_stop(OOP shards)
+{
+    struct shards * this = as_shards(shards);
+    pthread_mutex_lock(&this->lock);
+    this->shutdown = 1;
+    pthread_cond_broadcast(&this->start);
+    pthread_mutex_unlock(&this->lock);
+    int i;
+    for (i = 0; i < this->n_shards; ++i) {
+        struct shard * s = &this->shard[i];
+        pthread_join(s->thread, NULL);
+        gc_release(s->config);
+    }
+    for (i = 0; i < (this->n_shards * this->n_shards); ++i) {
+        spsc_release(&this->queue[i]);
+    }
+    FREE(this->queue);
+    FREE(this->shard);
+    this->n_shards = 0;
+    pthread_cond_destroy(&this->done);
+    pthread_cond_destroy(&this->start);
+    pthread_mutex_destroy(&this->lock);
+    gc_release(shards);
+}
+
+static KIND(route_give_x)
+{
+    struct route * this = as_route(self);
+    OOP evt = take_arg();
+    struct shards * group = this->group;
+    int to = shards_index(group, as_actor(as_event(evt)->actor)->config);
+    TRACE(fprintf(stderr, "%p route_kind {from:%d}\n", this, this->from));
+    TRACE(fprintf(stderr, "  %p: give! {event:%p, to:%d}\n", this, evt, to));
+    if (to == this->from) {  // an unowned actor, on the first shard
+        return object_call(group->shard[to].config, s_give_x, evt);
+    }
+    struct spsc * q = &group->queue[this->from * group->n_shards + to];
+    atomic_fetch_add(&group->remain, 1);  // counted before the receiver can see it
+    if ((object_call(q->overflow, s_empty_p) == o_true) && spsc_room(q)) {
+        spsc_put(q, evt);
+    } else {
+        object_call(q->overflow, s_give_x, evt);
+    }
+    return evt;
+}
+
+static struct methods route_methods = {
+    route_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_GIVE_X] = route_give_x,
+    }
+};
+
+static KIND(route_kind)
+{
+    return methods_dispatch(&route_methods, self, args);
+}
+
+static void
+shards_give(struct shards * this, OOP evt)
+{
+    int index = shards_index(this, as_actor(as_event(evt)->actor)->config);
+    TRACE(fprintf(stderr, "  %p: give! {event:%p, shard:%d}\n", this, evt, index));
+    atomic_fetch_add(&this->remain, 1);
+    object_call(this->shard[index].config, s_give_x, evt);
+}
+
+static KIND(shards_give_x)
+{
+    struct shards * this = as_shards(self);
+    OOP evt = take_arg();
+    TRACE(fprintf(stderr, "%p shards_kind {remain:%ld}\n", this, atomic_load(&this->remain)));
+    shards_give(this, evt);
+    return integer_new((int)atomic_load(&this->remain));
+}
+
+static KIND(shards_give_all_x)
+{
+    struct shards * this = as_shards(self);
+    OOP list = take_arg();
+    TRACE(fprintf(stderr, "%p shards_kind {remain:%ld}\n", this, atomic_load(&this->remain)));
+    TRACE(fprintf(stderr, "  %p: give_all! {events:%p}\n", this, list));
+    if (effects_kind == kind_of(list)) {
+        struct effects * ep = as_effects(list);
+        long i;
+        for (i = 0; i < ep->count; ++i) {
+            shards_give(this, ep->event[i]);
+        }
+    } else {
+        OOP events;
+        for (events = list; o_nil != events; events = as_pair(events)->t) {
+            shards_give(this, as_pair(events)->h);
+        }
+    }
+    return integer_new((int)atomic_load(&this->remain));
+}
+
+static KIND(shards_dispatch_x)
+{
+    struct shards * this = as_shards(self);
+    OOP count = take_arg();
+    TRACE(fprintf(stderr, "%p shards_kind {remain:%ld}\n", this, atomic_load(&this->remain)));
+    TRACE(fprintf(stderr, "  %p: dispatch {count:%d}\n", this, integer_value(count)));
+    pthread_mutex_lock(&this->lock);
+    atomic_store(&this->budget, integer_value(count));
+    atomic_store(&this->running, 1);
+    ++this->generation;
+    pthread_cond_broadcast(&this->start);
+    while ((atomic_load(&this->remain) > 0)
+    &&     ((atomic_load(&this->budget) > 0) || (atomic_load(&this->claimed) > 0))) {
+        pthread_cond_wait(&this->done, &this->lock);
+    }
+    atomic_store(&this->running, 0);
+    while (this->parked < this->n_shards) {  // wait for events in progress
+        pthread_cond_wait(&this->done, &this->lock);
+    }
+    pthread_mutex_unlock(&this->lock);
+    TRACE(fprintf(stderr, "  %p: remain=%ld\n", this, atomic_load(&this->remain)));
+    return integer_new((int)atomic_load(&this->remain));
+}
+
+static struct methods shards_methods = {
+    shards_kind, NULL, {
+        [SEL_EQ_P] = object_eq_p,
+        [SEL_GIVE_X] = shards_give_x,
+        [SEL_GIVE_ALL_X] = shards_give_all_x,
+        [SEL_DISPATCH_X] = shards_dispatch_x,
+    }
+};
+
+KIND(shards_kind)
+{
+    return methods_dispatch(&shards_methods, self, args);
+}